@@ -8,6 +8,7 @@ option(CXXLIB_CLANG       "Link against libc++"        OFF)
 option(CXXLIB_GCC         "Link against stdlibc++"     OFF)
 
 option(BUILD_TESTS        "Build testsuite"            OFF)
+option(BUILD_NATIVE       "Optimize for this machine"  OFF)
 option(DEBUG_LOGGER       "Enable extra debug logging" OFF)
 option(VERBOSE_TRACELOG   "Enable verbose trace logs"  OFF)
 option(DEBUG_HINTS        "Enable hints rendering"     OFF)
@@ -55,6 +55,7 @@ endif()
 
 message(STATUS "--------------------------")
 colored_option(STATUS " Build testsuite      ${BUILD_TESTS}" BUILD_TESTS "32;1" "37;2")
+colored_option(STATUS " Optimize for host    ${BUILD_NATIVE}" BUILD_NATIVE "32;1" "37;2")
 colored_option(STATUS " Debug logging        ${DEBUG_LOGGER}" DEBUG_LOGGER "32;1" "37;2")
 colored_option(STATUS " Verbose tracing      ${VERBOSE_TRACELOG}" VERBOSE_TRACELOG "32;1" "37;2")
 colored_option(STATUS " Draw debug hints     ${DEBUG_HINTS}" DEBUG_HINTS "32;1" "37;2")
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <optional>
+#include <utility>
+
+#include "common.hpp"
+#include "fuzzy.hpp"
+#include "item.hpp"
+
+namespace bookwyrm {
+
+/*
+ * What's wanted, prepared for matching many items against it: the fields that
+ * were asked for are found, indexed and tokenized once, up front, so that
+ * matching an item only looks at those fields and doesn't allocate.
+ */
+class compiled_query {
+public:
+    explicit compiled_query(const item &wanted);
+
+    /* Holds views into itself. */
+    compiled_query(const compiled_query&) = delete;
+    compiled_query& operator=(const compiled_query&) = delete;
+
+    /*
+     * How well the candidate matches what's wanted, the higher the better; or
+     * nothing, unless all specified exact values are equal and all specified
+     * non-exact values passes the fuzzy ratio.
+     *
+     * Reuses buffers between calls, so only one thread may match at a time.
+     */
+    std::optional<int> score(const item &candidate) const;
+
+    bool matches(const item &candidate) const
+    {
+        return score(candidate).has_value();
+    }
+
+private:
+    /* The exact values asked for: where they are in exacts_t::store(), and what they must be. */
+    vector<std::pair<size_t, int>> exacts_;
+    string_view extension_;
+
+    /* Sorted, for lookup. */
+    vector<string_view> isbns_;
+
+    /* Fuzzily matched fields that were asked for, and how much they count. */
+    using accessor = string_view (nonexacts_t::*)() const;
+    struct field {
+        accessor member;
+        int weight;
+        fuzzy::pattern wanted;
+        fuzzy::profile profile;
+    };
+    vector<field> fields_;
+
+    struct author {
+        string processed;
+        vector<string_view> tokens;
+    };
+    vector<author> authors_;
+
+    /* What the candidate's authors are processed and tokenized into. */
+    mutable fuzzy::scratch scratch_;
+    mutable string processed_;
+    mutable vector<string_view> tokens_;
+};
+
+/* ns bookwyrm */
+}
@@ -115,6 +115,12 @@ public:
     /* Get all values for a given option. (i.e. --author) */
     vector<string> get_many(const string &&opt) const;
 
+    /*
+     * Get the value for a given option as a positive number,
+     * or fallback if the option wasn't passed.
+     */
+    int get_number(const string &&opt, int fallback) const;
+
 private:
 
     /*
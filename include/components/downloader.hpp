@@ -16,12 +16,30 @@
  */
 
 #include <curl/curl.h>
+#include <cstdio>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
 #include <experimental/filesystem>
+#include <spdlog/spdlog.h>
 
 #include "common.hpp"
 #include "item.hpp"
 #include "time.hpp"
+#include "components/journal.hpp"
+
+/* Circular dependency guard. */
+namespace logger { class bookwyrm_logger; }
+using logger_t = std::shared_ptr<logger::bookwyrm_logger>;
 
 namespace fs = std::experimental::filesystem;
 
@@ -43,28 +61,312 @@ private:
     const bool use_unicode_, use_colour_;
 };
 
+struct transfer;
+
+/*
+ * A single curl transfer made on behalf of an item: a probe of one of its mirrors,
+ * the whole file, or a byte range of it.
+ */
+struct connection {
+    enum class kind { probe, whole, segment };
+
+    explicit connection(transfer &owner, kind type, size_t mirror)
+        : owner(owner), type(type), mirror(mirror) {}
+
+    transfer &owner;
+    const kind type;
+
+    /* Index of the mirror in transfer::uris this connection uses. */
+    size_t mirror;
+
+    CURL *handle = nullptr;
+
+    /*
+     * Where this connection started writing, where the next received byte is written,
+     * and the last byte wanted (-1 if until EOF).
+     */
+    curl_off_t first = 0, offset = 0, last = -1;
+
+    /* Segments only: mirrors this range has already failed on. */
+    vector<size_t> failed_mirrors;
+
+    /*
+     * Probes only: the file's full size according to the Content-Range header,
+     * and which version of the file the mirror serves.
+     */
+    curl_off_t total = -1;
+    string etag, last_modified;
+};
+
+/* What we learned about a mirror when probing it. */
+struct mirror_info {
+    /* Did the mirror answer the probe, or was it cancelled before it could? */
+    bool ok = false, answered = false;
+    bool accepts_ranges = false;
+    curl_off_t length = -1;
+    string etag, last_modified;
+
+    /* Seconds until the first byte of the probe arrived, and the rate of the rest (bytes/s). */
+    double ttfb = 0, throughput = 0;
+};
+
+/* How fast a host has been, averaged over the transfers we made with it. */
+struct host_stats {
+    double ttfb = 0, throughput = 0;
+    int samples = 0;
+};
+
+/*
+ * A single item being downloaded. All mirrors are first raced against each other by
+ * fetching the start of the file from each of them, which tells us the file's size,
+ * whether they serve byte ranges, and how fast they are. If they serve ranges, large
+ * files are downloaded in segments from all mirrors serving the same file; otherwise,
+ * the fastest mirror is used and the next fastest is only tried if it failed.
+ *
+ * Whatever has been written is recorded in a journal, so that a new mirror, or a
+ * later run, can pick up where the previous one left off.
+ */
+struct transfer {
+    enum class status { queued, probing, single, segmented, done, failed };
+
+    explicit transfer(size_t id, bookwyrm::item &&item)
+        : id(id), item(std::move(item)), uris(this->item.all_uris()) {}
+
+    /* What the item is known as by whoever handed it to us. */
+    const size_t id;
+
+    const bookwyrm::item item;
+
+    /* Where the item can be fetched from, as of when it was handed to us. */
+    const vector<string> uris;
+    status state = status::queued;
+
+    /* Where the item is written. Generated when the transfer is first started. */
+    fs::path filename;
+    int fd = -1;
+
+    /*
+     * Mirrors from fastest to slowest, as decided by the race, and which of them
+     * a single-stream download is currently using.
+     */
+    vector<size_t> order;
+    size_t attempt = 0;
+
+    /* Index of the mirror used for a single-stream download. */
+    size_t mirror = 0;
+
+    vector<mirror_info> mirrors;
+
+    /*
+     * The mirror we expect to win the race, judging by earlier transfers; the race ends
+     * as soon as it answers. Unset if we don't know all mirrors, or know none of them.
+     */
+    std::optional<size_t> favourite;
+
+    /* When the first mirror answered; the others have a short while left to do the same. */
+    std::optional<time::timer> race_started;
+    vector<std::unique_ptr<connection>> connections;
+
+    /* The byte ranges written by connections that are no longer running. */
+    journal progress;
+
+    /* File size (-1 if unknown) and how much of it has been written. */
+    curl_off_t size = -1, written = 0;
+};
+
+/* How an item handed to the downloader is doing. */
+struct download_status {
+    transfer::status state = transfer::status::queued;
+    curl_off_t written = 0, size = -1;
+};
+
 class downloader {
 public:
-    explicit downloader(string download_dir);
+    explicit downloader(string download_dir, int max_transfers = 4, int max_host_transfers = 2,
+            int max_segments = 4);
     ~downloader();
 
     /*
-     * Downloads the given items in a blocking, synchronous order.
+     * Downloads the given items, with up to max_transfers of them in parallel.
+     * Blocks until every item has either been downloaded or has run out of mirrors.
      * Returns true if at least one item was downloaded.
      */
-    bool sync_download(vector<bookwyrm::item> items);
+    bool sync_download(vector<bookwyrm::item> &&items);
+
+    /*
+     * Start downloading in the background: items are downloaded as soon as they are
+     * enqueued. The terminal is someone else's until wait() is called, so any messages
+     * are sent to the given logger instead, and on_update is called (from the download
+     * thread) whenever the status of an item has changed.
+     */
+    void async_download(logger_t logger, std::function<void()> on_update);
+
+    /* Download the given item as well. Does nothing if it is already enqueued. */
+    void enqueue(size_t id, const bookwyrm::item &item);
+    void enqueue(size_t id, bookwyrm::item &&item);
+
+    /*
+     * Stop downloading the given item. Whatever has been downloaded of it is kept,
+     * so that it can be resumed later. Finished downloads are left alone.
+     */
+    void cancel(size_t id);
+
+    /* How is the given item doing? Empty if it was never enqueued, or has been cancelled. */
+    std::optional<download_status> status(size_t id) const;
+
+    /*
+     * Stop reporting to the logger and calling on_update, e.g. because the TUI is closing.
+     * Messages are held back until wait() is called.
+     */
+    void detach();
+
+    /*
+     * Take back the terminal and block until all enqueued items are downloaded, drawing
+     * their progress. Returns true if at least one item was downloaded.
+     */
+    bool wait();
+
+    /* Cancel everything and stop downloading. */
+    void cancel_all();
 
     time::timer timer;
     progressbar pbar;
 
 private:
-    static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+    static size_t write_callback(char *data, size_t size, size_t nmemb, void *userp);
+    static size_t header_callback(char *data, size_t size, size_t nitems, void *userp);
 
-    /* Generates a relative filename in dldir to save the given item. */
+    /*
+     * Generates a relative filename in dldir to save the given item.
+     * A partially downloaded file of the same name is reused.
+     */
     fs::path generate_filename(const bookwyrm::item &item);
 
+    /*
+     * The download loop: start enqueued transfers, drive them, and report on them
+     * until we are told to close and nothing is left to do.
+     */
+    void run();
+
+    /* Pick up items enqueued and cancelled since we last looked. */
+    void take_requests();
+
+    /* Let whoever enqueued the items know how they are doing. */
+    void publish_status();
+
+    /* Tell the user something, wherever they are able to see it. */
+    void report(spdlog::level::level_enum level, const string &msg);
+
+    /* Create the transfer's file and probe all of its mirrors. */
+    void start(transfer &t);
+
+    /* Create an easy handle for the connection and hand it to curl. */
+    connection& add_connection(transfer &t, connection::kind type, size_t mirror,
+            curl_off_t offset = 0, curl_off_t last = -1);
+
+    /* Stop a connection, record what it wrote, and forget about it. */
+    void drop_connection(connection &c);
+
+    /* Is what we have of the file so far usable with what the given mirror serves? */
+    bool resumable(const transfer &t, size_t mirror) const;
+
+    /*
+     * Continue the file with data from the given mirror. If what we have
+     * doesn't fit with it, we start over from scratch.
+     */
+    void adopt_mirror(transfer &t, size_t mirror);
+
+    /* Write the transfer's journal, including what running connections have written. */
+    void save_journal(const transfer &t);
+
+    /* Called when a connection finishes, successfully or not. */
+    void on_probe_done(connection &c, CURLcode res);
+
+    /*
+     * End the transfer's race: cancel the probes still running, rank the
+     * mirrors by their speed, and start downloading from the fastest ones.
+     */
+    void decide(transfer &t);
+
+    /* Fold a measurement of a mirror's speed into what we know about its host (ttfb < 0 if not measured). */
+    void record_speed(const string &url, double ttfb, double throughput);
+
+    /* Estimated time (in seconds) to download a file of the given size; lower is better. */
+    static double score(double ttfb, double throughput, curl_off_t size);
+    void on_whole_done(connection &c, CURLcode res);
+    void on_segment_done(connection &c, CURLcode res);
+
+    /*
+     * Download the whole file from the transfer's current mirror, moving on
+     * to the next one if it can't be started. Fails the transfer when all
+     * mirrors are exhausted.
+     */
+    void start_single(transfer &t);
+
+    /*
+     * Split the missing parts of the file into byte ranges and fetch them in parallel
+     * from the given mirrors. Returns false if that couldn't be set up.
+     */
+    bool start_segmented(transfer &t, const vector<size_t> &sources);
+
+    /* Done with the transfer: close its file and report how it went. */
+    void finish(transfer &t, bool success);
+
+    /* Draw a progress line for each active transfer, and one for all of them. */
+    void draw_progress();
+
+    /* Erase whatever draw_progress() last wrote to the terminal. */
+    void clear_progress();
+
     const fs::path dldir;
-    CURL *curl;
+    const int max_transfers_, max_segments_;
+
+    CURLM *multi;
+
+    /* Every item handed to us that hasn't been cancelled. Only touched by run(). */
+    vector<std::unique_ptr<transfer>> transfers_;
+
+    /* Did any transfer succeed? */
+    bool any_success_ = false;
+
+    /* Guards the members below, which are shared with whoever enqueues items. */
+    mutable std::mutex queue_mutex_;
+    std::list<std::pair<size_t, bookwyrm::item>> incoming_;
+    vector<size_t> cancelled_;
+    std::map<size_t, download_status> status_;
+
+    /* Stop once everything is done? */
+    bool closing_ = false;
+
+    /* Signalled whenever any of the above is asked for, for run() to wait on when idle. */
+    std::condition_variable requested_;
+
+    std::thread worker_;
+
+    /* Whatever the download thread threw, rethrown by wait(). */
+    std::exception_ptr error_;
+
+    /* Is the terminal someone else's? Then messages go to the logger, or are held back. */
+    std::atomic<bool> quiet_ = false;
+    std::mutex report_mutex_;
+    logger_t logger_;
+    std::function<void()> on_update_;
+    vector<std::pair<spdlog::level::level_enum, string>> held_back_;
+
+    /* When was the status last published? */
+    time::timer status_timer_;
+
+    /* How many lines did the last draw_progress() print? */
+    size_t progress_lines_ = 0;
+
+    /* Files handed out by generate_filename(); a partial file is only resumed by one transfer. */
+    std::set<fs::path> claimed_;
+
+    /* When were the journals last written? */
+    time::timer journal_timer_;
+
+    /* How fast each host has been so far, keyed by host name and port. */
+    std::map<string, host_stats> hosts_;
 };
 
 }
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm {
+
+/*
+ * A sidecar file kept next to a partially downloaded file, recording where
+ * the file came from and which of its byte ranges we already have. With it,
+ * an interrupted download can continue where it left off, be it from the
+ * next mirror or the next time bookwyrm is run.
+ *
+ * On disk, it's a line-based list of key-value pairs:
+ *
+ *   url http://example.com/book.pdf
+ *   size 1048576
+ *   etag "5a3b-1f2e"
+ *   last-modified Thu, 01 Feb 2018 10:00:00 GMT
+ *   range 0 524288
+ *
+ * where each range is half-open: [first, last).
+ */
+struct journal {
+    using range = std::pair<int64_t, int64_t>;
+
+    string url, etag, last_modified;
+    int64_t size = -1;
+
+    /* Sorted, non-overlapping and non-adjacent. */
+    vector<range> ranges;
+
+    /* Where is the journal of the given file kept? */
+    static fs::path path_for(const fs::path &file);
+
+    /* Read the journal of the given file, if it has one. */
+    static std::optional<journal> load(const fs::path &file);
+
+    /* Write the journal of the given file, replacing any previous one. */
+    void save(const fs::path &file) const;
+
+    static void remove(const fs::path &file);
+
+    /* Record that the bytes [first, last) have been written. */
+    void add(int64_t first, int64_t last);
+
+    /* How many bytes do we have in total? */
+    int64_t bytes() const;
+
+    /* How many bytes, counted from the start of the file, do we have in one piece? */
+    int64_t prefix() const;
+
+    /* Which ranges of the file are we missing? */
+    vector<range> missing() const;
+};
+
+/* ns bookwyrm */
+}
@@ -17,6 +17,11 @@
 
 #pragma once
 
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <optional>
+
 #include "common.hpp"
 #include "item.hpp"
 #include "python.hpp"
@@ -42,19 +47,31 @@ class script_butler;
  * as well as which of them to update. User input post-cli is also handled here,
  * which is forwarded to the currently focused screen unless it was used to
  * manage screens.
+ *
+ * Only the thread running display() touches the screens and termbox. Other threads
+ * may only ask for a repaint or send log entries, which wakes that thread up.
  */
 class screen_butler {
 public:
     /* WARN: this constructor should only be used in make_with() above. */
-    explicit screen_butler(vector<bookwyrm::item> &items, logger_t logger);
+    explicit screen_butler(bookwyrm::item_store &items, bookwyrm::top_items *top, logger_t logger, int refresh_rate);
+    ~screen_butler();
 
-    /* Repaint all screens that need updating. */
+    /*
+     * Have the screens repainted. Safe to call from any thread, and cheap: the screens
+     * are only marked as dirty, and repainted by display() at most refresh_rate
+     * times a second, however many times this was called in between.
+     */
     void repaint_screens();
 
-    /* Send a log entry to the log screen. */
+    /* Send a log entry to the log screen. Safe to call from any thread. */
     void log_entry(spdlog::level::level_enum level, const string entry)
     {
-        log_->log_entry(level, entry);
+        {
+            std::lock_guard<std::mutex> guard(pending_mutex_);
+            pending_logs_.emplace_back(level, entry);
+        }
+
         repaint_screens();
     }
 
@@ -66,20 +83,26 @@ public:
      */
     bool display();
 
-    /* Take ownership of the wanted items and move them to the caller. */
-    vector<bookwyrm::item> get_wanted_items();
+    /* How many items were marked for download (and are being downloaded already). */
+    size_t wanted_item_count();
+
+    /* Download marked items right away, instead of when the TUI is closed. */
+    void set_downloader(std::shared_ptr<bookwyrm::downloader> downloader)
+    {
+        index_->set_downloader(downloader);
+    }
 
     /* Draw the context sensitive footer. */
     void print_footer();
 
     bool is_log_focused() const
     {
-        return focused_ == log_;
+        return log_focused_;
     }
 
 private:
     /* Forwarded to the multiselect menu. */
-    vector<bookwyrm::item> const &items_;
+    bookwyrm::item_store const &items_;
 
     /* Used to flush stored logs to the log screen. */
     logger_t logger_;
@@ -90,6 +113,34 @@ private:
 
     std::shared_ptr<screen::base> focused_, last_;
 
+    /* Mirrors focused_ == log_, for other threads to read. */
+    std::atomic<bool> log_focused_ = false;
+
+    /* Log entries sent from other threads, not yet added to the log screen. */
+    std::mutex pending_mutex_;
+    vector<std::pair<spdlog::level::level_enum, string>> pending_logs_;
+
+    /* Has anything changed since the screens were last painted? */
+    std::atomic<bool> dirty_ = false;
+
+    /* The least time between two paints. */
+    const std::chrono::microseconds frame_time_;
+
+    /*
+     * Written to by other threads (and on SIGWINCH) to wake display() up;
+     * the terminal itself is the other thing it waits on.
+     */
+    int wake_pipe_[2] = {-1, -1};
+
+    /* Repaint all screens. */
+    void paint_screens();
+
+    /*
+     * Handle a single terminal event. If it means the user is done, returns
+     * what display() should return.
+     */
+    std::optional<bool> handle_event(const keys::event &ev);
+
     /* Is a screen::item_details open? */
     bool viewing_details_;
 
@@ -135,7 +186,8 @@ private:
 
 namespace tui {
 
-std::shared_ptr<butler::screen_butler> make_with(butler::script_butler &script_butler, vector<py::module> &seekers, logger_t &logger);
+std::shared_ptr<butler::screen_butler> make_with(butler::script_butler &script_butler, vector<py::module> &seekers,
+        logger_t &logger, int refresh_rate);
 
 /* ns tui */
 }
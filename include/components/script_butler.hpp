@@ -20,10 +20,21 @@
 #include <mutex>
 #include <memory>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <sys/types.h>
 #include <spdlog/spdlog.h>
 
 #include "common.hpp"
 #include "item.hpp"
+#include "compiled_query.hpp"
+#include "dedup_index.hpp"
+#include "mpsc_queue.hpp"
+#include "top_items.hpp"
+#include "shm_ring.hpp"
+#include "wire.hpp"
+#include "plugin.hpp"
 #include "python.hpp"
 #include "components/logger.hpp"
 #include "components/screen_butler.hpp"
@@ -41,17 +52,54 @@ namespace butler {
 class script_butler;
 class screen_butler;
 
+/* What a seeker feeding us an item does when the queue of fed items is full. */
+enum class backpressure {
+    block, /* wait until there is room again */
+    drop   /* throw the item away */
+};
+
+/*
+ * Where the seekers run.
+ *
+ * There is no mode running each seeker in a Python sub-interpreter of its own:
+ * pybookwyrm is a pybind11 module, and pybind11 keeps its internals once per
+ * process, so it can't be imported into more than one interpreter; and only
+ * from Python 3.12 on may sub-interpreters have a GIL of their own. Processes
+ * give seekers a GIL each on any Python version.
+ */
+enum class seeker_mode {
+    threads,  /* in threads of ours, taking turns on the GIL */
+    processes /* each in a forked child, sending us what it finds through shared memory */
+};
+
 /*
  * The bookwyrm's very own butler. First, the butler finds
  * and loads all valid seeker scripts. When these scripts have all
  * started running in seperate threads, the butler will match items
  * fed to the bookwyrm with that is wanted. Only items matching
- * what is wanted will be pushed back into the items_ vector, and
+ * what is wanted will be pushed back into the items_ store, and
  * thus presented to the user.
+ *
+ * Fed items are only queued on the seeker's thread; the matching,
+ * storing and repainting is done in batches on a thread of our own.
+ *
+ * Seekers may instead run in child processes of their own (see seeker_mode),
+ * so that they don't share a GIL, and so that one crashing doesn't take
+ * us with it. They then write what they are fed into a ring in shared memory, and a
+ * thread of ours queues what matches as if fed here.
+ *
+ * Native seekers (see plugin.hpp) are found and run alongside the Python ones.
+ *
+ * Seekers whose find is a coroutine function (async def) don't get a thread each:
+ * they all run on one asyncio event loop, in a thread of their own. They feed us
+ * with bookwyrm.afeed, which yields to the loop instead of blocking it.
  */
 class script_butler {
 public:
-    explicit script_butler(const bookwyrm::item &&wanted, logger_t logger);
+    /* With top > 0, only the top best-scoring items are kept. */
+    explicit script_butler(bookwyrm::item &&wanted, logger_t logger,
+            backpressure when_full = backpressure::block, size_t top = 0,
+            seeker_mode mode = seeker_mode::threads);
 
     /*
      * Explicitly delete the copy-constructor.
@@ -65,14 +113,56 @@ public:
     explicit script_butler(const script_butler&) = delete;
     ~script_butler();
 
-    /* Find and load all seeker scripts. */
+    /* Find and load all seeker scripts, and any native seekers next to them. */
     vector<py::module> load_seekers();
 
-    /* Start a std::thread for each valid Python module found. */
+    /* Start a std::thread (or process) for each valid Python module and native seeker found. */
     void async_search(vector<py::module> &seekers);
 
-    /* Try to add a found item, and then update the set menu. */
-    void add_item(std::tuple<bookwyrm::nonexacts_t, bookwyrm::exacts_t, bookwyrm::misc_t> item_comps);
+    /* The parts of a found item, as fed by a seeker. */
+    using item_comps_t = bookwyrm::item::parts_t;
+
+    /*
+     * Queue a found item, to be matched and added to the menu by the consumer thread.
+     * Called from Python, but without the GIL: the item has been converted to
+     * native structs by then, and other seekers may run while we wait for room.
+     */
+    void add_item(item_comps_t item_comps);
+
+    /*
+     * Queue many found items at once. Cheaper per item than add_item for seekers
+     * that find a page of them at a time: they are converted in one go, and
+     * the consumer is woken once. Called without the GIL, like add_item.
+     */
+    void add_items(vector<item_comps_t> items);
+
+    /* Found items, converted once, that are fed a few at a time by try_add_items. */
+    struct item_batch {
+        explicit item_batch(vector<item_comps_t> &&items)
+            : items(std::move(items)) {}
+
+        vector<item_comps_t> items;
+
+        /* The first item not yet taken. */
+        size_t next = 0;
+    };
+
+    /*
+     * Queue as many of the batch's items as there is room for, without ever waiting:
+     * for seekers on an event loop, which must not block it. Returns whether all were
+     * taken (queued, or dropped if we may). If not, room_fd() becomes readable once
+     * there may be room for more; call room_made() then, and try again.
+     * Called without the GIL, like add_item.
+     */
+    bool try_add_items(item_batch &batch);
+
+    /* What to poll for room after try_add_items couldn't take everything. */
+    int room_fd() const
+    {
+        return ring_ ? ring_->writable_fd() : room_fd_;
+    }
+
+    void room_made();
 
     void log_entry(spdlog::level::level_enum lvl, string msg);
 
@@ -81,11 +171,17 @@ public:
         return destructing_.load();
     }
 
-    vector<bookwyrm::item>& results()
+    bookwyrm::item_store& results()
     {
         return items_;
     }
 
+    /* What to follow to list the results, if only the best are kept. */
+    bookwyrm::top_items* top()
+    {
+        return top_.get();
+    }
+
     /* Which menu do we update when a scripts feeds bookwyrm an item? */
     void set_screen_butler(std::shared_ptr<screen_butler> screen)
     {
@@ -93,20 +189,121 @@ public:
     }
 
 private:
+    /*
+     * Queue an item, waiting for room if the queue is full and we may not drop it.
+     * Returns false if it wasn't queued.
+     */
+    bool push(item_comps_t &&item_comps);
+
+    /* Let the consumer know there is something to do, if it's waiting. */
+    void wake_consumer();
+
+    /* A seeker running in a child process, and where it writes what it finds. */
+    struct worker {
+        pid_t pid;
+        int fd; /* closed when the child exits */
+        string name;
+        std::unique_ptr<bookwyrm::shm_ring> ring;
+    };
+
+    /* Fork a child for each seeker, and start a thread reading what they send. */
+    void fork_workers(vector<py::module> &seekers);
+
+    /*
+     * Fork a child running a seeker, sending what it feeds us to the parent through ring_.
+     * find() runs the seeker, returning false if it failed.
+     */
+    void fork_worker(vector<worker> &workers, const string &name, const std::function<bool()> &find);
+
+    /*
+     * Run coroutine seekers together on a new event loop in this thread, until they have
+     * all returned; they are cancelled if we are destructing. The GIL must be held.
+     * Returns false if any of them failed.
+     */
+    bool run_async(const vector<const py::module*> &seekers);
+
+    /* Run a native seeker until it returns, feeding us what it finds. */
+    void run_plugin(const bookwyrm::plugin &plugin);
+
+    /* The sink native seekers feed; the context is us. */
+    static void plugin_feed(void *context, const bookwyrm_item *items, size_t count);
+    static void plugin_log(void *context, int level, bookwyrm_str msg);
+    static int plugin_terminating(void *context);
+
+    /* In the child: write a record for the parent. Once it stops reading, we are terminating. */
+    void send(const string &record);
+
+    /*
+     * Read what a worker has written so far, queueing the items that match. They are matched
+     * where they lie in the ring, and only those that match are copied out of it.
+     * Returns whether any were queued. Throws value_error if the worker wrote garbage.
+     */
+    bool drain(worker &w, const bookwyrm::compiled_query &query);
+
+    /* Read from the workers until they have all exited, killing them if we are destructing. */
+    void read_workers(vector<worker> &workers);
+
+    /* Stop reading from a worker and wait for it to exit, after killing it if asked to. */
+    void reap(worker &w, bool kill);
+
+    /*
+     * Match queued items and add the wanted ones, merging duplicates into those found
+     * before, until the seekers are done and the queue empty.
+     */
+    void consume_items();
+
     logger_t logger_;
     const bookwyrm::item wanted_;
 
+    /* What's wanted, ready to match against. Only the consumer uses it. */
+    const bookwyrm::compiled_query query_;
+
+    /* What's wanted, as native seekers are handed it. */
+    const bookwyrm::plugin::query plugin_query_;
+
+    /* The native seekers found next to the scripts. */
+    vector<bookwyrm::plugin> plugins_;
+
     std::atomic<bool> destructing_ = false;
 
-    /* Somewhere to store our found items. */
-    vector<bookwyrm::item> items_;
+    /* The strings that repeat across stored items. Only the consumer interns into it; it outlives them. */
+    bookwyrm::string_pool strings_;
 
-    /* A lock for when multiple threads want to add an item. */
-    std::mutex items_mutex_;
+    /* Somewhere to store our found items. Only the consumer adds to it; the TUI reads it meanwhile. */
+    bookwyrm::item_store items_;
 
-    /* The same Python modules, but now running! */
+    /* Decides which items stay in the store, if not all of them do. */
+    std::unique_ptr<bookwyrm::top_items> top_;
+
+    /* Which stored items others are duplicates of. Only the consumer uses it. */
+    bookwyrm::dedup_index dedup_;
+
+    /* Where the seekers run. */
+    const seeker_mode mode_;
+
+    /* The same Python modules, but now running! (Or, if they run in processes, what reads from them.) */
     vector<std::thread> threads_;
 
+    /* Set in a worker process: where to send what the seeker feeds us. */
+    bookwyrm::shm_ring *ring_ = nullptr;
+
+    /* Items fed by the seekers, waiting to be matched. */
+    bookwyrm::mpsc_queue<item_comps_t> queue_;
+    const backpressure when_full_;
+    std::atomic<size_t> dropped_ = 0;
+
+    /* Written by the consumer once it has made room, if try_add_items wanted some. */
+    int room_fd_;
+    std::atomic<bool> room_wanted_ = false;
+
+    std::thread consumer_;
+    std::atomic<bool> seekers_done_ = false;
+
+    /* Where the consumer waits when there is nothing to do. */
+    std::atomic<bool> consumer_idle_ = false;
+    std::mutex consumer_mutex_;
+    std::condition_variable consumer_wakeup_;
+
     /* Which screens do we want to notify about updates? */
     std::shared_ptr<screen_butler> screen_butler_;
 };
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include "common.hpp"
+#include "item.hpp"
+
+namespace bookwyrm {
+
+/*
+ * Finds the stored item that another is a duplicate of: one of the same file type
+ * that shares an ISBN with it, or has the same title, authors and year, however
+ * they are capitalized and punctuated.
+ *
+ * Only the thread adding to the store may use it. Stored items may be replaced
+ * meanwhile; each lookup checks that what it finds is still a duplicate.
+ */
+class dedup_index {
+public:
+    explicit dedup_index(const item_store &store)
+        : store_(store) {}
+
+    /* The index of the stored item that the candidate duplicates, if any. */
+    std::optional<size_t> find(const item &candidate);
+
+    /* Remember the item stored at the given index. */
+    void add(size_t idx);
+
+private:
+    /* Keyed by normalized ISBN and extension. */
+    std::unordered_map<string, size_t> by_isbn_;
+
+    /* Keyed by a hash of normalized title, authors, year and extension. */
+    std::unordered_map<std::uint64_t, size_t> by_details_;
+
+    const item_store &store_;
+
+    /* Reused between lookups. */
+    string key_, other_key_, buffer_;
+    vector<string> authors_;
+};
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "common.hpp"
+
+/*
+ * String similarity, as fuzzywuzzy computes it, but working on views and
+ * caller-owned buffers so that comparing many strings doesn't allocate.
+ *
+ * All ratios are in percent: 100 for equal strings, and otherwise 0 if either
+ * string is empty. Two strings are as similar as the characters of the blocks
+ * difflib's SequenceMatcher matches up between them, over their mean length.
+ * Strings are compared byte by byte, as fuzzywuzzy's C++ port does.
+ *
+ * The matched characters are a common subsequence, so their longest common
+ * subsequence, which is much cheaper to find, bounds a ratio from above. It is
+ * used to skip comparisons that can't make a cutoff.
+ */
+namespace fuzzy {
+
+/*
+ * A string prepared for finding its longest common subsequence with others, one
+ * machine word of it at a time: for every byte value, a bitmask of where in the
+ * string it occurs. (See Hyyrö, "Bit-parallel LCS-length computation revisited".)
+ */
+class pattern {
+public:
+    using mask_t = std::uint64_t;
+    static constexpr size_t word_bits = 64;
+
+    pattern() = default;
+    explicit pattern(string_view str);
+
+    /* Reuses the masks' memory, if there is enough of it. */
+    void assign(string_view str);
+
+    string_view str() const
+    {
+        return str_;
+    }
+
+    /* The length of the longest common subsequence of the pattern and the text. */
+    int lcs(string_view text) const;
+
+    /* How many words the masks span. */
+    size_t words() const
+    {
+        return words_;
+    }
+
+    /* Where the byte occurs in the pattern. */
+    const mask_t* masks(unsigned char c) const
+    {
+        return masks_.data() + c * words_;
+    }
+
+private:
+    string str_;
+    size_t words_ = 0;
+
+    /* words_ masks per byte value. */
+    vector<mask_t> masks_;
+
+    /* Where the computation is done, when the pattern is longer than a word. */
+    mutable vector<mask_t> state_;
+};
+
+/*
+ * A coarse histogram of a string: how many of its characters fall into each of
+ * 64 buckets. It bounds how many characters another string can have in common
+ * with it, cheaply enough to turn away hopeless strings before they are compared.
+ *
+ * (Longer grams don't help here: sharing three in four characters in order
+ * doesn't guarantee sharing any bigrams.)
+ */
+class profile {
+public:
+    profile() = default;
+    explicit profile(string_view str);
+
+    /*
+     * Could partial_ratio() of the profiled string and this text reach the
+     * cutoff? If not, it certainly can't.
+     */
+    bool may_reach(string_view text, int cutoff) const;
+
+private:
+    std::array<std::uint32_t, 64> counts_ = {};
+    size_t length_ = 0;
+};
+
+/* A run of characters difflib matched up: a[i, i + k) equals b[j, j + k). */
+struct block {
+    int i, j, k;
+};
+
+/* Buffers reused between comparisons; one per thread. */
+struct scratch {
+    pattern needle;
+    string sect, a_rest, b_rest;
+    std::array<int, 256> counts;
+
+    /* Where each byte is in the second string, grouped by byte: those of c from b2j_start[c] on. */
+    vector<int> b2j;
+    std::array<int, 257> b2j_start;
+
+    /* The lengths of matches ending at each position of the second string, for this and the last byte of the first. */
+    vector<int> j2len, new_j2len, touched, new_touched;
+
+    vector<std::array<int, 4>> queue;
+    vector<block> blocks, windows;
+};
+
+/*
+ * Normalize a string for comparing it loosely: ASCII letters are lowercased,
+ * other ASCII characters that aren't digits become spaces, and the result is
+ * trimmed. Bytes of multibyte UTF-8 characters are kept as they are.
+ * The result is written into out, and a view of it returned.
+ */
+string_view normalize(string_view str, string &out);
+
+/*
+ * Process a string the way fuzzywuzzy's full_process does, with force_ascii: non-ASCII
+ * bytes are dropped, ASCII characters other than letters, digits and underscores
+ * become spaces, letters are lowercased, and the result is trimmed.
+ * The result is written into out, and a view of it returned.
+ */
+string_view full_process(string_view str, string &out);
+
+/* Split a normalized (or processed) string into its words, sorted and without duplicates. */
+void tokenize(string_view str, vector<string_view> &out);
+
+int ratio(string_view a, string_view b, scratch &s);
+
+/*
+ * The best ratio of the shorter string against the substrings of the longer that
+ * difflib's matching blocks line it up with. Ratios below the cutoff may be
+ * reported as 0, which lets comparisons that can't reach it be skipped.
+ *
+ * Like all of difflib, not quite symmetric: which string is which matters when
+ * they are equally long. The second may be given as a pattern, if one is at hand.
+ */
+int partial_ratio(string_view a, string_view b, scratch &s, int cutoff = 0);
+int partial_ratio(string_view a, const pattern &b, scratch &s, int cutoff = 0);
+
+/*
+ * Compare two tokenized strings by the words they share, followed by those they
+ * don't: a string whose words are all in the other scores 100. The strings should
+ * have been processed by full_process first, as fuzzywuzzy does.
+ */
+int token_set_ratio(const vector<string_view> &a, const vector<string_view> &b, scratch &s);
+
+/* ns fuzzy */
+}
@@ -19,9 +19,13 @@
 
 #include <cassert>
 #include <array>
+#include <atomic>
+#include <memory>
 #include <tuple>
 
 #include "common.hpp"
+#include "segmented_vector.hpp"
+#include "string_pool.hpp"
 #include "utils.hpp"
 #include "components/command_line.hpp"
 
@@ -40,33 +44,50 @@ enum { empty = -1 };
  */
 enum class year_mod { equal, eq_gt, eq_lt, lt, gt, unused };
 
-struct exacts_t {
+/*
+ * The strings of an item part are views. Whatever a part is constructed from, or copied
+ * from, it copies into a buffer of its own, which moves along with it; only parts
+ * constructed field by field borrow their strings, until told to own() them.
+ * Once an item is kept, the strings that repeat across items are interned into the
+ * pool of the search instead (see keep()), so that each is stored only once.
+ */
+
+class exacts_t {
+public:
     /* Holds exact data about an item (year, page count, format, etc.). */
     explicit exacts_t(const cliparser &cli)
         : exacts_t{get_yearmod(cli), cli} {}
 
-    explicit exacts_t(const std::map<string, int> &dict, const string &extension)
-        : ymod(year_mod::unused),
-        year(get_value(dict, "year")),
-        edition(get_value(dict, "edition")),
-        volume(get_value(dict, "volume")),
-        number(get_value(dict, "number")),
-        pages(get_value(dict, "pages")),
-        extension(extension) {}
-
-    const year_mod ymod;
-    const int year,
-              edition,
-              volume,  /* no associated flag */
-              number,  /* no associated flag */
-              pages;   /* no associated flag */
-
-    const string extension;
-
-    /* Convenience container */
-    const std::array<int, 6> store = {{
-        year, edition, volume, number, pages
-    }};
+    explicit exacts_t(const std::map<string, int> &dict, const string &extension);
+
+    /* Field by field, as is: the extension is borrowed. */
+    explicit exacts_t(int year, int edition, int volume, int number, int pages, string_view extension)
+        : ymod_(year_mod::unused), year_(year), edition_(edition), volume_(volume), number_(number),
+        pages_(pages), extension_(extension) {}
+
+    exacts_t(const exacts_t &other);
+    exacts_t(exacts_t&&) = default;
+
+    year_mod ymod() const { return ymod_; }
+    int year() const      { return year_; }
+    int edition() const   { return edition_; }
+    int volume() const    { return volume_; }  /* no associated flag */
+    int number() const    { return number_; }  /* no associated flag */
+    int pages() const     { return pages_; }   /* no associated flag */
+
+    string_view extension() const { return extension_; }
+
+    /* Convenience container: the values above, in that order. */
+    std::array<int, 5> store() const
+    {
+        return {{year_, edition_, volume_, number_, pages_}};
+    }
+
+    /* Copy the extension into a buffer of our own. */
+    void own();
+
+    /* Intern the extension into the pool instead. */
+    void keep(string_pool &pool);
 
 private:
     static int parse_number(const cliparser &cli, const string &&opt);
@@ -75,70 +96,172 @@ private:
     /* Parse the year which may have a prefixed modifier. */
     static const std::pair<year_mod, int> get_yearmod(const cliparser &cli);
 
-    explicit exacts_t(const std::pair<year_mod, int> &pair, const cliparser &cli)
-        : ymod(std::get<0>(pair)), year(std::get<1>(pair)),
-        edition(parse_number(cli, "edition")),
-        volume(parse_number(cli, "volume")),
-        number(parse_number(cli, "number")),
-        pages(parse_number(cli, "pages")),
-        extension(cli.get("extension")) {}
+    explicit exacts_t(const std::pair<year_mod, int> &pair, const cliparser &cli);
+
+    year_mod ymod_;
+    int year_, edition_, volume_, number_, pages_;
+    string_view extension_;
+
+    std::unique_ptr<char[]> buffer_;
 };
 
-struct nonexacts_t {
+class nonexacts_t {
+public:
     /* Holds strings, which are matched fuzzily. */
-    explicit nonexacts_t(const cliparser &cli)
-        : authors(cli.get_many("author")),
-        title(cli.get("title")),
-        series(cli.get("series")),
-        publisher(cli.get("publisher")),
-        journal(cli.get("journal")) {}
-
-    explicit nonexacts_t(const std::map<string, string> &dict, const vector<string> &authors)
-        : authors(authors),
-        title(get_value(dict, "title")),
-        series(get_value(dict, "series")),
-        publisher(get_value(dict, "publisher")),
-        journal(get_value(dict, "journal")) {}
-
-    const vector<string> authors;
-    const string title;
-    const string series;
-    const string publisher;
-    const string journal;
+    explicit nonexacts_t(const cliparser &cli);
+
+    explicit nonexacts_t(const std::map<string, string> &dict, const vector<string> &authors);
+
+    /* Field by field, as is: all strings are borrowed. */
+    explicit nonexacts_t(vector<string_view> &&authors, string_view title, string_view series,
+            string_view publisher, string_view journal)
+        : authors_(std::move(authors)), title_(title), series_(series), publisher_(publisher),
+        journal_(journal) {}
+
+    nonexacts_t(const nonexacts_t &other);
+    nonexacts_t(nonexacts_t&&) = default;
+
+    const vector<string_view>& authors() const { return authors_; }
+    string_view title() const     { return title_; }
+    string_view series() const    { return series_; }
+    string_view publisher() const { return publisher_; }
+    string_view journal() const   { return journal_; }
+
+    /* Copy all strings into a buffer of our own. */
+    void own();
+
+    /* Intern the authors, publisher and journal into the pool instead; own the rest. */
+    void keep(string_pool &pool);
 
 private:
-    static const string get_value(const std::map<string, string> &dict, const string &&key);
+    static string_view get_value(const std::map<string, string> &dict, const string &&key);
+
+    vector<string_view> authors_;
+    string_view title_;
+    string_view series_;
+    string_view publisher_;
+    string_view journal_;
+
+    std::unique_ptr<char[]> buffer_;
 };
 
-struct misc_t {
+class misc_t {
+public:
     /* Holds everything else. */
-    explicit misc_t(const vector<string> &uris, const vector<string> &isbns)
-        : uris(uris), isbns(isbns) {}
+    explicit misc_t(const vector<string> &uris, const vector<string> &isbns);
     explicit misc_t() {} // cannot be initialized from cli options
 
-    const vector<string> uris;
-    const vector<string> isbns;
+    /* As is: all strings are borrowed. */
+    explicit misc_t(vector<string_view> &&uris, vector<string_view> &&isbns)
+        : uris_(std::move(uris)), isbns_(std::move(isbns)) {}
+
+    misc_t(const misc_t &other);
+    misc_t(misc_t&&) = default;
+
+    const vector<string_view>& uris() const  { return uris_; }
+    const vector<string_view>& isbns() const { return isbns_; }
+
+    /* Copy all strings into a buffer of our own. Nothing here repeats, so there is no keep(). */
+    void own();
+
+private:
+    vector<string_view> uris_;
+    vector<string_view> isbns_;
+
+    std::unique_ptr<char[]> buffer_;
+};
+
+/*
+ * Somewhere else an item can be found, as reported by another seeker.
+ * Added to by whoever stores the item, while others read it: an entry is
+ * complete before it is linked in, and never changes after.
+ */
+class mirror_list {
+public:
+    mirror_list() = default;
+    mirror_list(const mirror_list &other);
+
+    /* Only while nobody else reads either list. */
+    mirror_list(mirror_list &&other) noexcept
+        : head_(other.head_.exchange(nullptr, std::memory_order_relaxed)) {}
+
+    mirror_list& operator=(const mirror_list&) = delete;
+    ~mirror_list();
+
+    /* Writer only. */
+    void add(const string_view &uri);
+
+    /* Oldest first. */
+    vector<string_view> get() const;
+
+private:
+    struct node {
+        const string uri;
+        const node *next;
+    };
+
+    /* The newest entry. */
+    std::atomic<const node*> head_ = nullptr;
 };
 
 class item {
 public:
+    using parts_t = std::tuple<nonexacts_t, exacts_t, misc_t>;
+
     explicit item(const cliparser &cli)
-        : nonexacts(cli), exacts(cli) {}
+        : nonexacts_(cli), exacts_(cli) {}
+
+    /* Construct an item from a pybind11::tuple, taking over its parts. */
+    explicit item(parts_t &&parts)
+        : nonexacts_(std::get<0>(std::move(parts))), exacts_(std::get<1>(std::move(parts))),
+        misc_(std::get<2>(std::move(parts))) {}
+
+    const nonexacts_t& nonexacts() const { return nonexacts_; }
+    const exacts_t& exacts() const       { return exacts_; }
+    const misc_t& misc() const           { return misc_; }
+
+    /* Take the item apart again, so that its parts can be moved on rather than copied. */
+    parts_t release() &&
+    {
+        return parts_t(std::move(nonexacts_), std::move(exacts_), std::move(misc_));
+    }
 
-    /* Construct an item from a pybind11::tuple. */
-    explicit item(const std::tuple<nonexacts_t, exacts_t, misc_t> &tuple)
-        : nonexacts(std::get<0>(tuple)), exacts(std::get<1>(tuple)), misc(std::get<2>(tuple)) {}
+    /* How well it matched what's wanted (see compiled_query::score). */
+    int score() const { return score_; }
+    void set_score(int score) { score_ = score; }
+
+    /* Every known place to fetch the item from: its own, then its mirrors. */
+    vector<string> all_uris() const;
 
     /*
-     * Returns true if all specified exact values are equal
-     * and if all specified non-exact values passes the fuzzy ratio.
+     * Add the URIs of a duplicate found by another seeker as mirrors, unless they are
+     * known already. Returns whether any were. Only whoever stores the item may call this.
      */
-    bool matches(const item &wanted) const;
+    bool add_mirrors(const item &duplicate);
+
+    /* Copy the strings of an item constructed field by field, so that it outlives them. */
+    void own();
 
-    const nonexacts_t nonexacts;
-    const exacts_t exacts;
-    const misc_t misc;
+    /*
+     * Intern the strings that repeat across items into the pool of the search, and
+     * keep only the rest to ourselves. For items that are stored: they must not outlive
+     * the pool, but copies of them may.
+     */
+    void keep(string_pool &pool);
+
+private:
+    nonexacts_t nonexacts_;
+    exacts_t exacts_;
+    misc_t misc_;
+
+    int score_ = 0;
+
+    /* Where else the same item was found. */
+    mirror_list mirrors_;
 };
 
+/* Found items: added to by a single thread, while others read them. */
+using item_store = segmented_vector<item>;
+
 /* ns bookwyrm */
 }
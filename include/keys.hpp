@@ -78,11 +78,12 @@ struct event {
 };
 
 /*
- * Abstraction of termbox's tb_poll_event.
- * Updates the passed keys::event struct with the data given
- * by tb_event_poll.
+ * Abstraction of termbox's tb_peek_event.
+ * Waits at most timeout ms for an event, and updates the passed
+ * keys::event struct with the data given by tb_peek_event.
+ * Returns the event type, 0 if there was no event, or -1 on error.
  */
-bool poll_event(event &ev);
+int peek_event(event &ev, int timeout);
 
 /* ns keys */
 }
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace bookwyrm {
+
+/*
+ * A bounded, lock-free queue which any number of threads may push into,
+ * but only a single thread may pop from.
+ *
+ * Each cell carries a sequence number telling whose turn it is: a producer may fill
+ * a cell when its sequence equals the position being pushed to, and the consumer may
+ * empty it when the sequence is one past the position being popped from. Producers
+ * only contend on the push position, and never wait on each other or the consumer.
+ * (See Dmitry Vyukov's bounded MPMC queue, of which this is the single-consumer case.)
+ */
+template <typename T>
+class mpsc_queue {
+public:
+    /* The capacity is rounded up to the closest power of two. */
+    explicit mpsc_queue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+
+        mask_ = size - 1;
+        cells_ = std::make_unique<cell[]>(size);
+        for (size_t i = 0; i < size; i++)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpsc_queue()
+    {
+        /* Destroy whatever was never popped. */
+        for (size_t pos = tail_; ; pos++) {
+            cell &c = cells_[pos & mask_];
+            if (c.sequence.load(std::memory_order_acquire) != pos + 1)
+                break;
+
+            c.value()->~T();
+        }
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    /*
+     * Push a value, unless the queue is full. Safe to call from any thread.
+     * The value is only moved from if it was pushed.
+     */
+    template <typename U>
+    bool try_push(U &&value)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell &c = cells_[pos & mask_];
+            const size_t seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+            if (diff == 0) {
+                /* The cell is free; claim it, unless another producer beat us to it. */
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (&c.storage) T(std::forward<U>(value));
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                /* The consumer hasn't emptied this cell yet: we are full. */
+                return false;
+            } else {
+                /* Someone pushed here already; try wherever the head is now. */
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*
+     * Pop up to max values, oldest first, passing each to the given function.
+     * Returns how many were popped. Consumer only.
+     */
+    template <typename Func>
+    size_t consume(Func &&func, size_t max)
+    {
+        size_t n = 0;
+        for (; n < max; n++) {
+            cell &c = cells_[tail_ & mask_];
+            if (c.sequence.load(std::memory_order_acquire) != tail_ + 1)
+                break;
+
+            func(std::move(*c.value()));
+            release(c);
+        }
+
+        return n;
+    }
+
+    /* Is there nothing to pop? Only accurate when called by the consumer. */
+    bool empty() const
+    {
+        return cells_[tail_ & mask_].sequence.load(std::memory_order_acquire) != tail_ + 1;
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T* value()
+        {
+            return std::launder(reinterpret_cast<T*>(&storage));
+        }
+    };
+
+    /* Destroy the popped value and hand the cell back to the producers, one lap later. */
+    void release(cell &c)
+    {
+        c.value()->~T();
+        c.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+        tail_++;
+    }
+
+    size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+
+    /* Kept on separate cache lines, so that producers and the consumer don't trip over each other. */
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) size_t tail_ = 0;
+};
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/filesystem>
+
+#include "common.hpp"
+#include "item.hpp"
+#include "seeker_plugin.h"
+
+namespace bookwyrm {
+
+namespace fs = std::experimental::filesystem;
+
+/* A native seeker, loaded from a shared object (see seeker_plugin.h). */
+class plugin {
+public:
+    /* Throws program_error if it can't be loaded, or isn't a seeker we can run. */
+    explicit plugin(const fs::path &path);
+
+    /* Is the file named like a native seeker? Nothing else may be loaded as one. */
+    static bool is_plugin(const fs::path &path);
+    ~plugin();
+
+    plugin(plugin &&other) noexcept;
+    plugin(const plugin&) = delete;
+    plugin& operator=(const plugin&) = delete;
+
+    const string& name() const
+    {
+        return name_;
+    }
+
+    void find(const bookwyrm_item &wanted, const bookwyrm_sink &sink) const
+    {
+        seeker_->find(&wanted, &sink);
+    }
+
+    /*
+     * What is wanted, as plugins are handed it. Views into the given item, and so
+     * only valid for as long as it is.
+     */
+    class query {
+    public:
+        explicit query(const item &wanted);
+
+        query(const query&) = delete;
+        query& operator=(const query&) = delete;
+
+        const bookwyrm_item& get() const
+        {
+            return query_;
+        }
+
+    private:
+        vector<bookwyrm_str> authors_, uris_, isbns_;
+        bookwyrm_item query_;
+    };
+
+    /* An item as fed by a plugin. Views into what was fed: own() it to keep it. */
+    static item to_item(const bookwyrm_item &fed);
+
+private:
+    void *handle_;
+    const bookwyrm_seeker *seeker_;
+    string name_;
+};
+
+/* ns bookwyrm */
+}
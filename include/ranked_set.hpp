@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+#include "common.hpp"
+
+namespace bookwyrm {
+
+/*
+ * An ordered multiset that can also be indexed by rank: where an element would
+ * land in sorted order, and which element is at a given place, are both found in
+ * logarithmic time, as are insertions.
+ *
+ * It is a treap: a binary search tree on the keys which is also a heap on random
+ * priorities, which keeps it balanced in expectation. Each node knows the size of
+ * its subtree, which is what ranks are counted with.
+ */
+template <typename Key, typename Compare = std::less<Key>>
+class ranked_set {
+public:
+    /*
+     * Insert a key after any equal ones, and return its rank:
+     * how many keys come before it.
+     */
+    size_t insert(const Key &key)
+    {
+        size_t n;
+        if (free_.empty()) {
+            n = nodes_.size();
+            nodes_.push_back({key, next_priority(), 1, nil, nil});
+        } else {
+            n = free_.back();
+            free_.pop_back();
+            nodes_[n] = {key, next_priority(), 1, nil, nil};
+        }
+
+        size_t rank = 0;
+        root_ = insert(root_, n, rank);
+        return rank;
+    }
+
+    /* Erase a key, which must be in the set, and return the rank it had. */
+    size_t erase(const Key &key)
+    {
+        size_t rank = 0;
+        root_ = erase(root_, key, rank);
+        return rank;
+    }
+
+    /* The key of the given rank, which must be below size(). */
+    const Key& operator[](size_t rank) const
+    {
+        assert(rank < size());
+
+        size_t n = root_;
+        for (;;) {
+            const size_t left = size(nodes_[n].left);
+            if (rank < left) {
+                n = nodes_[n].left;
+            } else if (rank == left) {
+                return nodes_[n].key;
+            } else {
+                rank -= left + 1;
+                n = nodes_[n].right;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return size(root_);
+    }
+
+    bool empty() const
+    {
+        return root_ == nil;
+    }
+
+private:
+    static constexpr size_t nil = std::numeric_limits<size_t>::max();
+
+    /* Nodes refer to each other by index; those of erased keys are reused. */
+    struct node {
+        Key key;
+        std::uint32_t priority;
+        size_t size, left, right;
+    };
+
+    size_t size(size_t n) const
+    {
+        return n == nil ? 0 : nodes_[n].size;
+    }
+
+    void update(size_t n)
+    {
+        nodes_[n].size = size(nodes_[n].left) + size(nodes_[n].right) + 1;
+    }
+
+    /* Split the subtree into the keys that go before the given one, and those that go after. */
+    void split(size_t t, const Key &key, size_t &left, size_t &right)
+    {
+        if (t == nil) {
+            left = right = nil;
+        } else if (compare_(key, nodes_[t].key)) {
+            split(nodes_[t].left, key, left, nodes_[t].left);
+            right = t;
+            update(t);
+        } else {
+            split(nodes_[t].right, key, nodes_[t].right, right);
+            left = t;
+            update(t);
+        }
+    }
+
+    /* Insert node n into the subtree, counting the keys that end up before it. Returns the new subtree. */
+    size_t insert(size_t t, size_t n, size_t &rank)
+    {
+        if (t == nil)
+            return n;
+
+        /* The new node belongs above this one: it takes the subtree apart. */
+        if (nodes_[n].priority > nodes_[t].priority) {
+            split(t, nodes_[n].key, nodes_[n].left, nodes_[n].right);
+            rank += size(nodes_[n].left);
+            update(n);
+            return n;
+        }
+
+        if (compare_(nodes_[n].key, nodes_[t].key)) {
+            nodes_[t].left = insert(nodes_[t].left, n, rank);
+        } else {
+            rank += size(nodes_[t].left) + 1;
+            nodes_[t].right = insert(nodes_[t].right, n, rank);
+        }
+
+        update(t);
+        return t;
+    }
+
+    /* Join two subtrees, all keys of the left going before those of the right. */
+    size_t merge(size_t left, size_t right)
+    {
+        if (left == nil) return right;
+        if (right == nil) return left;
+
+        if (nodes_[left].priority > nodes_[right].priority) {
+            nodes_[left].right = merge(nodes_[left].right, right);
+            update(left);
+            return left;
+        }
+
+        nodes_[right].left = merge(left, nodes_[right].left);
+        update(right);
+        return right;
+    }
+
+    /* Erase the key from the subtree, counting the keys before it. Returns the new subtree. */
+    size_t erase(size_t t, const Key &key, size_t &rank)
+    {
+        assert(t != nil);
+
+        if (compare_(key, nodes_[t].key)) {
+            nodes_[t].left = erase(nodes_[t].left, key, rank);
+        } else if (compare_(nodes_[t].key, key)) {
+            rank += size(nodes_[t].left) + 1;
+            nodes_[t].right = erase(nodes_[t].right, key, rank);
+        } else {
+            rank += size(nodes_[t].left);
+            free_.push_back(t);
+            return merge(nodes_[t].left, nodes_[t].right);
+        }
+
+        update(t);
+        return t;
+    }
+
+    /* xorshift32; the priorities only need to look random to the keys. */
+    std::uint32_t next_priority()
+    {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        return seed_;
+    }
+
+    vector<node> nodes_;
+    vector<size_t> free_;
+    size_t root_ = nil;
+    std::uint32_t seed_ = 2463534242;
+    Compare compare_;
+};
+
+/* ns bookwyrm */
+}
@@ -63,7 +63,9 @@ namespace vt100 {
                         reset_colour  = "\033[0m",
                         hide_cursor   = "\033[?25l",
                         show_cursor   = "\033[?25h",
-                        erase_line    = "\033[K";
+                        erase_line    = "\033[K",
+                        prev_line     = "\033[F",
+                        erase_down    = "\033[J";
 }
 
 }
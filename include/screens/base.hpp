@@ -71,6 +71,12 @@ public:
      */
     virtual int scrollpercent() const = 0;
 
+    /* The terminal termbox reads input from, for polling it. */
+    static int terminal_fd()
+    {
+        return tty_fd_;
+    }
+
 protected:
     explicit base(int pad_top, int pad_bot, int pad_left, int pad_right);
     ~base();
@@ -127,6 +133,7 @@ protected:
 
 private:
     static int screen_count_;
+    static int tty_fd_;
     static void init_tui();
 };
 
@@ -25,13 +25,19 @@
 #include <variant>
 
 #include "item.hpp"
+#include "ranked_set.hpp"
+#include "top_items.hpp"
 #include "screens/base.hpp"
 
+/* Circular dependency guard. */
+namespace bookwyrm { class downloader; }
+
 namespace screen {
 
 class multiselect_menu : public base {
 public:
-    explicit multiselect_menu(vector<bookwyrm::item> const &items);
+    /* If only the best items are kept, top decides which are listed. */
+    explicit multiselect_menu(bookwyrm::item_store const &items, bookwyrm::top_items *top = nullptr);
 
     void paint() override;
     void on_resize() override;
@@ -53,19 +59,33 @@ public:
 
     const bookwyrm::item& selected_item() const
     {
-        return items_[selected_item_];
+        return items_[item_at(selected_item_)];
     }
 
+    /* How many items are listed; those found since the last paint aren't, yet. */
     size_t item_count() const
     {
-        return items_.size();
+        return ranking_.size();
     }
 
-    auto marked_items()
+    const auto& marked_items() const
     {
         return marked_items_;
     }
 
+    /*
+     * List the items found (and unlist those evicted) since we last looked, in order of
+     * their score. Done on every paint, but also whenever the screens are painted while
+     * we aren't, so that evicted items are let go of however long we stay out of view.
+     */
+    void rank_new_items();
+
+    /* Download items as soon as they are marked, and show how they are doing. */
+    void set_downloader(std::shared_ptr<bookwyrm::downloader> downloader)
+    {
+        downloader_ = downloader;
+    }
+
 private:
     struct columns_t {
 
@@ -95,7 +115,7 @@ private:
         auto end()    { return columns_.end();   }
 
     private:
-        std::array<column_t, 6> columns_;
+        std::array<column_t, 7> columns_;
     };
 
     /* Store data about each column between updates. */
@@ -108,13 +128,42 @@ private:
     size_t scroll_offset_;
 
     std::mutex menu_mutex_;
-    vector<bookwyrm::item> const &items_;
+    bookwyrm::item_store const &items_;
+
+    /*
+     * The listed items' indices, ordered best match first (by negated score),
+     * then by when they were found. Rows index this; everything else indexes items_.
+     */
+    bookwyrm::ranked_set<std::pair<int, size_t>> ranking_;
+
+    bookwyrm::top_items *top_;
+
+    /* Items evicted from the top, but still listed for as long as the user cares about them. */
+    std::set<size_t> evicted_;
 
     /* Item indices marked for download. */
     std::set<int> marked_items_;
 
+    /* Where marked items are sent, if anywhere. */
+    std::shared_ptr<bookwyrm::downloader> downloader_;
+
+    /* The index of the item listed on the given row. */
+    size_t item_at(const size_t row) const
+    {
+        return ranking_[row].second;
+    }
+
+    void list_item(const size_t idx);
+    void unlist_item(const size_t idx);
+
+    /* Is the user looking at, or downloading, the item? */
+    bool is_pinned(const size_t idx) const;
+
     bool is_marked(const size_t idx) const;
 
+    /* A short description of how the item's download is doing, if it is being downloaded. */
+    string download_status(const size_t idx) const;
+
     /* How many entries can the menu print in the terminal? */
     size_t menu_capacity() const;
 
@@ -136,7 +185,8 @@ private:
     void update_column_widths();
 
     void print_header();
-    void print_column(const size_t col_idx);
+    /* Print the given column for the first count items. */
+    void print_column(const size_t col_idx, const size_t count);
 };
 
 } /* ns screen */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The interface of native seeker plugins: shared objects, found alongside the Python
+ * seekers, that export bookwyrm_plugin(). Their file names must end in
+ * BOOKWYRM_SEEKER_SUFFIX: no other shared object there is ever loaded, lest its
+ * constructors run before we could tell it isn't a seeker. Written in C, so that plugins don't need to
+ * be built with the same compiler (or language) as bookwyrm.
+ *
+ * A plugin is run just like a Python seeker: its find() is called, in a thread or a
+ * process of its own, with what is wanted and a sink to feed what it finds into.
+ * Strings are not NUL-terminated, and are only borrowed: bookwyrm copies what it keeps
+ * before a call returns, and whatever bookwyrm hands out is valid until find() returns.
+ *
+ * Built like so:
+ *   cc -shared -fPIC -I path/to/bookwyrm/include -o my.seeker.so my-seeker.c
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What the file name of a native seeker ends with. */
+#define BOOKWYRM_SEEKER_SUFFIX ".seeker.so"
+
+/* Bumped whenever anything below changes. */
+#define BOOKWYRM_SEEKER_ABI 2
+
+/* Log levels, as the Python seekers' pybookwyrm.loglevel. */
+enum {
+    BOOKWYRM_LOG_DEBUG = 1,
+    BOOKWYRM_LOG_INFO  = 2,
+    BOOKWYRM_LOG_WARN  = 3,
+    BOOKWYRM_LOG_ERROR = 4
+};
+
+/* The value of an integer field nobody specified. */
+#define BOOKWYRM_EMPTY (-1)
+
+/* How the wanted year is to be compared, as the Python seekers' pybookwyrm.year_mod. */
+enum {
+    BOOKWYRM_YEAR_EQUAL = 0, /* -y 2157 */
+    BOOKWYRM_YEAR_EQ_GT = 1, /* -y =>2157: that year or later */
+    BOOKWYRM_YEAR_EQ_LT = 2, /* -y =<2157: that year or earlier */
+    BOOKWYRM_YEAR_LT    = 3, /* -y <2157 */
+    BOOKWYRM_YEAR_GT    = 4  /* -y >2157 */
+};
+
+struct bookwyrm_str {
+    const char *data;
+    size_t size;
+};
+
+struct bookwyrm_strs {
+    const struct bookwyrm_str *data;
+    size_t size;
+};
+
+/* An item, as found; and (with unspecified fields left empty) what is wanted. */
+struct bookwyrm_item {
+    struct bookwyrm_strs authors;
+    struct bookwyrm_str title, series, publisher, journal;
+
+    int32_t year, edition, volume, number, pages;
+    struct bookwyrm_str extension;
+
+    /* One of the above, for what is wanted. Ignored in found items, whose year is what it is. */
+    int32_t year_mod;
+
+    struct bookwyrm_strs uris, isbns;
+};
+
+struct bookwyrm_sink {
+    void *context;
+
+    /* Feed found items, as many at a time as convenient. */
+    void (*feed)(void *context, const struct bookwyrm_item *items, size_t count);
+
+    void (*log)(void *context, int level, struct bookwyrm_str msg);
+
+    /* Should find() return as soon as it can? */
+    int (*terminating)(void *context);
+};
+
+struct bookwyrm_seeker {
+    /* BOOKWYRM_SEEKER_ABI, as the plugin was built with. */
+    uint32_t abi;
+
+    const char *name;
+
+    void (*find)(const struct bookwyrm_item *wanted, const struct bookwyrm_sink *sink);
+};
+
+/* What every plugin exports. */
+const struct bookwyrm_seeker *bookwyrm_plugin(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace bookwyrm {
+
+/*
+ * An append-only sequence which a single writer may grow while any number of
+ * readers read what has been appended so far, without locks.
+ *
+ * Elements are stored in segments that double in size, and are never moved:
+ * growing only allocates a new segment. A new element is fully constructed before
+ * the size is bumped, so a reader sees every element below the size it loaded.
+ */
+template <typename T>
+class segmented_vector {
+public:
+    segmented_vector() = default;
+
+    segmented_vector(const segmented_vector&) = delete;
+    segmented_vector& operator=(const segmented_vector&) = delete;
+
+    ~segmented_vector()
+    {
+        const size_t count = size_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++)
+            at(i).~T();
+
+        for (T *segment : segments_)
+            ::operator delete(segment);
+    }
+
+    /* Append an element. Writer only. */
+    template <typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        const size_t i = size_.load(std::memory_order_relaxed);
+        const auto [segment, offset] = locate(i);
+
+        if (!segments_[segment])
+            segments_[segment] = static_cast<T*>(::operator new(segment_size(segment) * sizeof(T)));
+
+        T *element = new (segments_[segment] + offset) T(std::forward<Args>(args)...);
+
+        /* Publish it. */
+        size_.store(i + 1, std::memory_order_release);
+        return *element;
+    }
+
+    void push_back(const T &value)
+    {
+        emplace_back(value);
+    }
+
+    void push_back(T &&value)
+    {
+        emplace_back(std::move(value));
+    }
+
+    /*
+     * Replace an element with another. Writer only, and only once no reader
+     * looks at the element any more; readers must be told about the new one.
+     */
+    template <typename... Args>
+    T& replace(size_t i, Args&&... args)
+    {
+        T *element = &at(i);
+        element->~T();
+        return *new (element) T(std::forward<Args>(args)...);
+    }
+
+    /*
+     * How many elements may be read. Readers should load this once and stick to it
+     * for as long as they need a consistent view; it only grows.
+     */
+    size_t size() const
+    {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /* The element at the given index, which must be below a size() loaded earlier. */
+    const T& operator[](size_t i) const
+    {
+        return at(i);
+    }
+
+    T& operator[](size_t i)
+    {
+        return at(i);
+    }
+
+private:
+    /* The first segment holds this many elements (as a power of two); each next one twice as many. */
+    static constexpr size_t first_bits = 6;
+
+    /* Enough segments for any number of elements we could address. */
+    static constexpr size_t max_segments = sizeof(size_t) * 8 - first_bits;
+
+    static constexpr size_t segment_size(size_t segment)
+    {
+        return size_t(1) << (segment + first_bits);
+    }
+
+    /* Which segment an index is in, and where in it. */
+    static std::pair<size_t, size_t> locate(size_t i)
+    {
+        /* Offset the index so that segment boundaries fall on powers of two. */
+        const size_t j = i + segment_size(0);
+        const size_t msb = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(j);
+        const size_t segment = msb - first_bits;
+
+        return {segment, j - (size_t(1) << msb)};
+    }
+
+    T& at(size_t i) const
+    {
+        assert(i < size_.load(std::memory_order_relaxed));
+
+        const auto [segment, offset] = locate(i);
+        return segments_[segment][offset];
+    }
+
+    /*
+     * Only the writer changes these, and only beyond the published size,
+     * so readers never see a segment being allocated.
+     */
+    std::array<T*, max_segments> segments_ = {};
+    std::atomic<size_t> size_ = 0;
+};
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#include "common.hpp"
+
+namespace bookwyrm {
+
+/*
+ * A ring of records in memory shared with a child process, which one of the two
+ * writes to and the other reads from, without locks or copying it out: the reader
+ * looks at a record where it lies until it releases it. Map it before forking.
+ *
+ * Each record is its length followed by its bytes, padded to four bytes. Records are
+ * never split across the end of the ring; the writer marks the rest as skipped
+ * instead. Whoever waits for the other (the reader for a record, the writer for room)
+ * says so, and is then woken through an eventfd; otherwise nobody makes a syscall.
+ */
+class shm_ring {
+public:
+    /* The capacity is rounded up to the closest power of two. Throws program_error on failure. */
+    explicit shm_ring(size_t capacity);
+    ~shm_ring();
+
+    shm_ring(const shm_ring&) = delete;
+    shm_ring& operator=(const shm_ring&) = delete;
+
+    /* The largest record that fits. */
+    size_t max_record() const;
+
+    /*
+     * Writer: append a record, waiting up to timeout_ms for room if there is none.
+     * Returns whether it was appended.
+     */
+    bool write(const string_view &record, int timeout_ms);
+
+    /*
+     * Writer, for those that mustn't block in write(): append the record, which must
+     * fit (see max_record), if there is room, and return true. Otherwise, say that we will wait for writable_fd() and
+     * return false; call done_waiting_to_write() once it is readable.
+     */
+    bool write_or_prepare_wait(const string_view &record);
+    void done_waiting_to_write();
+    int writable_fd() const
+    {
+        return writable_fd_;
+    }
+
+    /*
+     * Reader: the oldest record, if there is one. It stays put until released.
+     * Throws value_error if the writer has scribbled over the ring.
+     */
+    std::optional<string_view> peek();
+
+    /* Reader: drop the record peek returned, making room for the writer. */
+    void release();
+
+    /*
+     * Reader: say that we are about to wait for readable_fd(), unless there are records
+     * to read after all, which is returned. Call done_waiting() after waiting.
+     */
+    bool prepare_wait();
+    void done_waiting();
+    int readable_fd() const
+    {
+        return readable_fd_;
+    }
+
+    /* Reader: we will read no more. The writer learns this the next time it waits. */
+    void close();
+
+    /* Writer: has the reader closed the ring? */
+    bool closed() const;
+
+private:
+    struct header {
+        alignas(64) std::atomic<uint64_t> head; /* where the writer writes next */
+        alignas(64) std::atomic<uint64_t> tail; /* where the reader reads next */
+        alignas(64) std::atomic<uint32_t> reader_waiting, writer_waiting, closed;
+    };
+
+    bool try_write(const string_view &record);
+    void wake(int fd);
+
+    header *header_;
+    char *data_;
+    size_t capacity_;
+
+    /* Where the record given out by peek ends. */
+    uint64_t pending_ = 0;
+
+    int readable_fd_, writable_fd_;
+};
+
+/* ns bookwyrm */
+}
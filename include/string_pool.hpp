@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_set>
+
+#include "common.hpp"
+
+namespace bookwyrm {
+
+/*
+ * Where the strings that repeat across the items of a search live: each distinct
+ * string is stored once, in large chunks that are only freed with the pool. The same
+ * publishers, extensions, journals and authors turn up over and over again, so
+ * kept items' fields are views into here instead of strings of their own.
+ *
+ * Only one thread may intern, but any may read what it got back without further
+ * care: an interned string never changes or moves.
+ */
+class string_pool {
+public:
+    string_pool() = default;
+
+    string_pool(const string_pool&) = delete;
+    string_pool& operator=(const string_pool&) = delete;
+
+    /* The stored copy of the given string, which is stored first if it isn't already. */
+    string_view intern(const string_view &str);
+
+    /* How many distinct strings are stored, and in how many bytes. Interning thread only. */
+    size_t count() const;
+    size_t bytes() const;
+
+private:
+    /* Copy a string into the current chunk, starting a new one if it doesn't fit. */
+    string_view store(const string_view &str);
+
+    std::unordered_set<string_view> stored_;
+
+    vector<std::unique_ptr<char[]>> chunks_;
+    char *free_ = nullptr;
+    size_t left_ = 0, bytes_ = 0;
+};
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <utility>
+
+#include "common.hpp"
+#include "item.hpp"
+#include "mpsc_queue.hpp"
+
+namespace bookwyrm {
+
+/*
+ * Keeps only the K best-scoring items offered to it, so that memory stays flat
+ * however many are found: the slots of an item_store that worse items are evicted
+ * from are filled again with better ones.
+ *
+ * One thread offers items. Another, which lists them, follows along: it is told
+ * which slots were filled and which evicted, and releases evicted slots once it
+ * no longer looks at them. Only then are they filled again.
+ */
+class top_items {
+public:
+    explicit top_items(item_store &store, size_t k);
+
+    top_items(const top_items&) = delete;
+    top_items& operator=(const top_items&) = delete;
+
+    /*
+     * Keep the item if it is among the K best so far, and return the slot it was kept in.
+     * Never waits for the follower, however far behind it is.
+     */
+    std::optional<size_t> offer(item &&candidate);
+
+    /* Learn which slots were filled and evicted since last time, in that order. */
+    void follow(const std::function<void(size_t)> &filled, const std::function<void(size_t)> &evicted);
+
+    /* Let an evicted slot be filled again. */
+    void release(size_t idx);
+
+    size_t capacity() const
+    {
+        return k_;
+    }
+
+private:
+    struct change {
+        size_t idx;
+        bool filled;
+    };
+
+    void publish(change c);
+
+    item_store &store_;
+    const size_t k_;
+
+    /* The scores and slots of what's kept, worst on top. Only the offering thread uses it. */
+    std::priority_queue<std::pair<int, size_t>, vector<std::pair<int, size_t>>, std::greater<>> kept_;
+
+    /* What the follower hasn't seen yet. */
+    mpsc_queue<change> changes_;
+
+    /*
+     * Changes that didn't fit in changes_, and come after all of those in it. While
+     * there are any, all changes go here, lest the follower see them out of order.
+     */
+    std::atomic<bool> overflowed_ = false;
+    std::mutex overflow_mutex_;
+    vector<change> overflow_;
+
+    /* Slots that may be filled again. */
+    std::mutex released_mutex_;
+    vector<size_t> released_;
+};
+
+/* ns bookwyrm */
+}
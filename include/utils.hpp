@@ -44,6 +44,7 @@ inline bool any_intersection(const Set &a, const Set &b)
 std::error_code validate_download_dir(const fs::path &path);
 
 string vector_to_string(const vector<string> &vec);
+string vector_to_string(const vector<string_view> &vec);
 vector<string> split_string(const string &str);
 std::pair<string, string> split_at_first(const string &str, string &&sep);
 
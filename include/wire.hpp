@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#include <spdlog/common.h>
+
+#include "common.hpp"
+#include "item.hpp"
+
+/*
+ * How seekers running in processes of their own tell us what they find: records,
+ * each being its kind (8 bits) followed by a payload. Integers are 32 bits and
+ * strings are prefixed by their length; lists of strings by their count. Both ends
+ * are the same program on the same machine, so it's all in native byte order.
+ * Where one record ends and the next begins is up to whatever carries them.
+ */
+namespace wire {
+
+enum class kind : uint8_t { item, log };
+
+/* Append a record of a found item, or of a log entry, to the buffer. */
+void put_item(string &buf, const bookwyrm::nonexacts_t &nonexacts, const bookwyrm::exacts_t &exacts,
+        const bookwyrm::misc_t &misc);
+void put_log(string &buf, spdlog::level::level_enum lvl, const string &msg);
+
+/* What a record is. Throws value_error if it is empty or of no known kind. */
+kind kind_of(const string_view &record);
+
+/*
+ * The item in a record. Its strings are views into the record, so that it can be
+ * matched where it lies: it's only good for as long as the record is, unless it's
+ * told to own its strings (see item::own).
+ * Throws value_error if the record is malformed.
+ */
+bookwyrm::item get_item(const string_view &record);
+
+/* The log entry in a record. Throws value_error if the record is malformed. */
+std::pair<spdlog::level::level_enum, string> get_log(const string_view &record);
+
+/* ns wire */
+}
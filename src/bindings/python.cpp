@@ -26,6 +26,12 @@
 
 namespace bw = bookwyrm;
 
+/* Items hold views into strings they own or share, which Python gets copies of. */
+static vector<string> strings(const vector<string_view> &views)
+{
+    return vector<string>(views.cbegin(), views.cend());
+}
+
 PYBIND11_MODULE(pybookwyrm, m)
 {
     m.attr("__doc__") = "bookwyrm python bindings";
@@ -45,12 +51,12 @@ PYBIND11_MODULE(pybookwyrm, m)
 
     py::class_<bw::exacts_t>(m, "exacts_t")
         .def(py::init<const std::map<string, int>&, const string&>())
-        .def_readonly("year",      &bw::exacts_t::year)
-        .def_readonly("edition",   &bw::exacts_t::edition)
-        .def_readonly("extension", &bw::exacts_t::extension)
-        .def_readonly("volume",    &bw::exacts_t::volume)
-        .def_readonly("number",    &bw::exacts_t::number)
-        .def_readonly("pages",     &bw::exacts_t::pages)
+        .def_property_readonly("year",      &bw::exacts_t::year)
+        .def_property_readonly("edition",   &bw::exacts_t::edition)
+        .def_property_readonly("extension", [](const bw::exacts_t &c) { return string(c.extension()); })
+        .def_property_readonly("volume",    &bw::exacts_t::volume)
+        .def_property_readonly("number",    &bw::exacts_t::number)
+        .def_property_readonly("pages",     &bw::exacts_t::pages)
         /* .def_readwrite("lang",    &bw::exacts_t::lang) */
         .def("__repr__", [](const bw::exacts_t &c) {
             return fmt::format(
@@ -62,18 +68,18 @@ PYBIND11_MODULE(pybookwyrm, m)
                 "\tnumber:    {}\n"
                 "\tpages:     {}\n",
                 /* "\tlanguage:  {}\n>", */
-                c.year, c.edition, c.extension, c.volume,
-                c.number, c.pages //, c.lang
+                c.year(), c.edition(), string(c.extension()), c.volume(),
+                c.number(), c.pages() //, c.lang
             );
         });
 
     py::class_<bw::nonexacts_t>(m, "nonexacts_t")
         .def(py::init<const std::map<string, string>&, const vector<string>&>())
-        .def_readonly("authors",   &bw::nonexacts_t::authors)
-        .def_readonly("title",     &bw::nonexacts_t::title)
-        .def_readonly("serie",     &bw::nonexacts_t::series)
-        .def_readonly("publisher", &bw::nonexacts_t::publisher)
-        .def_readonly("journal",   &bw::nonexacts_t::journal)
+        .def_property_readonly("authors",   [](const bw::nonexacts_t &c) { return strings(c.authors()); })
+        .def_property_readonly("title",     [](const bw::nonexacts_t &c) { return string(c.title()); })
+        .def_property_readonly("serie",     [](const bw::nonexacts_t &c) { return string(c.series()); })
+        .def_property_readonly("publisher", [](const bw::nonexacts_t &c) { return string(c.publisher()); })
+        .def_property_readonly("journal",   [](const bw::nonexacts_t &c) { return string(c.journal()); })
         .def("__repr__", [](const bw::nonexacts_t &c) {
             return fmt::format(
                 "<pybookwyrm.nonexacts_t with fields:\n"
@@ -82,25 +88,94 @@ PYBIND11_MODULE(pybookwyrm, m)
                 "\tpublisher: '{}'\n"
                 "\tjournal:   '{}'\n"
                 "\tauthors:   '{}'\n>",
-                c.title, c.series, c.publisher, c.journal,
-                utils::vector_to_string(c.authors)
+                string(c.title()), string(c.series()), string(c.publisher()), string(c.journal()),
+                utils::vector_to_string(c.authors())
             );
         });
 
     py::class_<bw::misc_t>(m, "misc_t")
         .def(py::init<const vector<string>&, const vector<string>&>())
-        .def_readonly("isbns", &bw::misc_t::isbns)
-        .def_readonly("uris", &bw::misc_t::uris);
+        .def_property_readonly("isbns", [](const bw::misc_t &c) { return strings(c.isbns()); })
+        .def_property_readonly("uris",  [](const bw::misc_t &c) { return strings(c.uris()); });
 
     py::class_<bw::item>(m, "item")
-        .def_readonly("nonexacts", &bw::item::nonexacts)
-        .def_readonly("exacts",    &bw::item::exacts)
+        .def_property_readonly("nonexacts", &bw::item::nonexacts)
+        .def_property_readonly("exacts",    &bw::item::exacts)
         .def("__repr__", [](const bw::item &i) {
-            return "<bookwyrm.item with title '" + i.nonexacts.title + "'>";
+            return "<bookwyrm.item with title '" + string(i.nonexacts().title()) + "'>";
         });
 
+    /* Converted once, when made; fed from by try_feed_many. */
+    py::class_<butler::script_butler::item_batch>(m, "item_batch")
+        .def(py::init([](vector<butler::script_butler::item_comps_t> items) {
+            return butler::script_butler::item_batch(std::move(items));
+        }));
+
     py::class_<butler::script_butler>(m, "bookwyrm")
-        .def("feed",        &butler::script_butler::add_item)
+        /* Arguments are converted with the GIL held; the C++ side runs without it. */
+        .def("feed",        &butler::script_butler::add_item,  py::call_guard<py::gil_scoped_release>())
+        .def("feed_many",   &butler::script_butler::add_items, py::call_guard<py::gil_scoped_release>())
+        .def("try_feed_many", &butler::script_butler::try_add_items, py::call_guard<py::gil_scoped_release>())
+        .def("room_fd",     &butler::script_butler::room_fd)
+        .def("room_made",   &butler::script_butler::room_made)
         .def("terminating", &butler::script_butler::is_destructing)
-        .def("log",         &butler::script_butler::log_entry);
+        .def("log",         &butler::script_butler::log_entry, py::call_guard<py::gil_scoped_release>());
+
+    /*
+     * For seekers whose find is a coroutine: feed without blocking the event loop,
+     * letting the other seekers on it run while there is no room for more items.
+     * Defined in a scope of their own, which they keep for their globals.
+     */
+    py::dict scope;
+    scope["__builtins__"] = py::module::import("builtins");
+    scope["bookwyrm"] = m.attr("bookwyrm");
+    scope["item_batch"] = m.attr("item_batch");
+
+    py::exec(R"(
+import asyncio
+
+# Per event loop: the seekers on it waiting for room, all woken by one reader.
+_waiting = {}
+
+def _stop_waiting(loop, fd):
+    loop.remove_reader(fd)
+    return _waiting.pop(loop)
+
+async def room(self):
+    loop = asyncio.get_event_loop()
+    fd = self.room_fd()
+
+    if loop not in _waiting:
+        _waiting[loop] = []
+
+        def made():
+            self.room_made()
+            for fut in _stop_waiting(loop, fd):
+                if not fut.done():
+                    fut.set_result(None)
+
+        loop.add_reader(fd, made)
+
+    fut = loop.create_future()
+    _waiting[loop].append(fut)
+    try:
+        await fut
+    finally:
+        # Cancelled, with nobody else left waiting: stop watching.
+        waiting = _waiting.get(loop)
+        if waiting is not None and all(f.done() for f in waiting):
+            _stop_waiting(loop, fd)
+
+async def afeed_many(self, items):
+    batch = item_batch(list(items))
+    while not self.try_feed_many(batch):
+        await self.room()
+
+async def afeed(self, item):
+    await self.afeed_many([item])
+
+bookwyrm.room = room
+bookwyrm.afeed_many = afeed_many
+bookwyrm.afeed = afeed
+)", scope);
 }
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "compiled_query.hpp"
+
+static constexpr int fuzzy_min = 75;
+
+/*
+ * What a match scores: each fuzzy field's ratio, weighted, plus a bonus for
+ * each one that is exactly what was asked for (which partial_ratio can't tell
+ * from a longer string that contains it). Exact values must all be equal to
+ * match at all, so they add nothing; a wanted ISBN, however, trumps anything.
+ */
+static constexpr int title_weight = 3,
+                     author_weight = 2,
+                     series_weight = 1,
+                     publisher_weight = 1,
+                     exact_bonus = 25,
+                     isbn_bonus = 1000;
+
+namespace bookwyrm {
+
+compiled_query::compiled_query(const item &wanted)
+    : extension_(wanted.exacts().extension()), isbns_(wanted.misc().isbns())
+{
+    const auto store = wanted.exacts().store();
+    for (size_t i = 0; i < store.size(); i++) {
+        if (store[i] != empty)
+            exacts_.emplace_back(i, store[i]);
+    }
+
+    std::sort(isbns_.begin(), isbns_.end());
+
+    /*
+     * partial: useful for course literature that can have some
+     * crazy long titles. Also useful for publishers, because
+     * some entries may not use the full name.
+     */
+    const std::pair<accessor, int> weighted[] = {
+        {&nonexacts_t::title, title_weight},
+        {&nonexacts_t::series, series_weight},
+        {&nonexacts_t::publisher, publisher_weight}
+    };
+
+    for (const auto& [member, weight] : weighted) {
+        const string_view value = (wanted.nonexacts().*member)();
+        if (value.empty()) continue;
+
+        /* Compared as they are, as fuzzywuzzy's partial_ratio does. */
+        fields_.push_back({member, weight, fuzzy::pattern(value), fuzzy::profile(value)});
+    }
+
+    /* Tokenize only once all strings are in place, lest the views dangle. */
+    for (const auto &name : wanted.nonexacts().authors()) {
+        authors_.emplace_back();
+        fuzzy::full_process(name, authors_.back().processed);
+    }
+
+    for (auto &a : authors_)
+        fuzzy::tokenize(a.processed, a.tokens);
+}
+
+std::optional<int> compiled_query::score(const item &candidate) const
+{
+    int score = 0;
+
+    /* Return nothing if any exact value doesn't match what's wanted. */
+    const auto store = candidate.exacts().store();
+    for (const auto& [idx, value] : exacts_) {
+        if (store[idx] != value)
+            return std::nullopt;
+    }
+
+    /* Ad-hoc the file type, for now. */
+    if (!extension_.empty() && candidate.exacts().extension() != extension_)
+        return std::nullopt;
+
+    /* Does the item contain a wanted ISBN? */
+    if (!isbns_.empty()) {
+        const auto &got = candidate.misc().isbns();
+        const bool any = std::any_of(got.cbegin(), got.cend(), [this](const string_view &isbn) {
+            return std::binary_search(isbns_.cbegin(), isbns_.cend(), isbn);
+        });
+
+        if (!any) return std::nullopt;
+        score += isbn_bonus;
+    }
+
+    /* Turn away what can't possibly match before looking closer. */
+    for (const auto &f : fields_) {
+        if (!f.profile.may_reach((candidate.nonexacts().*f.member)(), fuzzy_min))
+            return std::nullopt;
+    }
+
+    for (const auto &f : fields_) {
+        const string_view got = (candidate.nonexacts().*f.member)();
+        const int ratio = fuzzy::partial_ratio(got, f.wanted, scratch_, fuzzy_min);
+        if (ratio < fuzzy_min)
+            return std::nullopt;
+
+        score += f.weight * ratio;
+        if (got == f.wanted.str())
+            score += exact_bonus;
+    }
+
+    if (authors_.empty())
+        return score;
+
+    /*
+     * From some quick testing, it feels like token_set_ratio
+     * works best here.
+     */
+    int best = 0;
+    for (const auto &name : candidate.nonexacts().authors()) {
+        fuzzy::tokenize(fuzzy::full_process(name, processed_), tokens_);
+
+        for (const auto &a : authors_) {
+            best = std::max(best, fuzzy::token_set_ratio(a.tokens, tokens_, scratch_));
+            if (best == 100) break;
+        }
+
+        if (best == 100) break;
+    }
+
+    if (best < fuzzy_min)
+        return std::nullopt;
+
+    return score + author_weight * best;
+}
+
+/* ns bookwyrm */
+}
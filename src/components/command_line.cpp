@@ -159,6 +159,27 @@ vector<string> cliparser::get_many(const string &&opt) const
     return values;
 }
 
+int cliparser::get_number(const string &&opt, int fallback) const
+{
+    if (!has(opt))
+        return fallback;
+
+    const auto value = get(opt);
+
+    try {
+        size_t end;
+        const int number = std::stoi(value, &end);
+
+        if (end == value.length() && number > 0)
+            return number;
+    } catch (const std::exception&) {
+        /* Handled below. */
+    }
+
+    throw value_error("malformed value '" + value + "' for argument --" + opt +
+            "; a positive number is expected");
+}
+
 void cliparser::process_arguments(const vector<string> &args)
 {
     bool skip_next_arg = false;
@@ -20,25 +20,140 @@
 #include <cerrno>
 #include <cstring>
 #include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <algorithm>
 #include <iomanip>
+#include <limits>
+#include <numeric>
 #include <sstream>
 
 #include <fmt/ostream.h>
 
 #include "components/downloader.hpp"
+#include "components/logger.hpp"
 #include "runes.hpp"
 #include "utils.hpp"
 
 namespace bookwyrm {
 
-downloader::downloader(string download_dir)
-    : pbar(true, true), dldir(download_dir)
+/* A file must be at least twice this large to be downloaded in segments. */
+static constexpr curl_off_t min_segment_size = 4 * 1024 * 1024;
+
+/* How much of the file each mirror gets to send us during a race. */
+static constexpr curl_off_t probe_size = 64 * 1024;
+
+/* Once a mirror has answered, the others have this long (in ms) to do the same. */
+static constexpr double race_grace = 1000;
+
+/* The host (and port) part of a URL, which is what mirror speeds are remembered by. */
+static string host_of(const string &url)
+{
+    auto start = url.find("://");
+    start = start == string::npos ? 0 : start + 3;
+
+    const auto end = url.find_first_of("/?#", start);
+    string host = url.substr(start, end == string::npos ? string::npos : end - start);
+
+    /* Skip any credentials. */
+    if (const auto at = host.rfind('@'); at != string::npos)
+        host.erase(0, at + 1);
+
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+    return host;
+}
+
+/* Format a duration in seconds as e.g. "1h 02m 03s". */
+static string format_eta(long seconds)
+{
+    time::duration eta(seconds);
+    std::stringstream eta_ss;
+    if (eta.hours() > 0) {
+        eta_ss << eta.hours() << "h "
+               << std::setfill('0') << std::setw(2) << eta.minutes() << "m "
+               << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
+    } else if (eta.minutes() > 0) {
+        eta_ss << eta.minutes() << "m "
+               << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
+    } else {
+        eta_ss << eta.seconds() << "s";
+    }
+
+    return eta_ss.str();
+}
+
+/* Download rate unit conversion. */
+static string format_rate(double rate)
+{
+    constexpr auto k = 1024,
+                   M = 1048576;
+
+    if (rate > M)
+        return fmt::format("{:.2f}MB/s", rate / M);
+    else
+        return fmt::format("{:.2f}kB/s", rate / k);
+}
+
+static int terminal_width()
+{
+    struct winsize w;
+    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    return w.ws_col;
+}
+
+downloader::downloader(string download_dir, int max_transfers, int max_host_transfers, int max_segments)
+    : pbar(true, true), dldir(download_dir), max_transfers_(max_transfers), max_segments_(max_segments)
 {
     curl_global_init(CURL_GLOBAL_ALL);
-    curl = curl_easy_init();
+    multi = curl_multi_init();
+    if (!multi) throw component_error("curl could not initialize");
+
+    /*
+     * Limit how many connections we open in total, and how many of them
+     * may go to the same host; some mirrors don't take kindly to being hammered.
+     * Transfers over the limit are queued by curl until a connection frees up.
+     */
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(max_transfers * max_segments));
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(max_host_transfers));
+
+    /* std::cout << rune::vt100::hide_cursor; */
+}
+
+downloader::~downloader()
+{
+    if (worker_.joinable())
+        cancel_all();
+
+    /* Anything still open was cancelled when we were destroyed; keep it for later. */
+    for (auto &t : transfers_) {
+        while (!t->connections.empty())
+            drop_connection(*t->connections.back());
+
+        if (t->fd >= 0) {
+            close(t->fd);
+            save_journal(*t);
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    curl_global_cleanup();
+
+    /* std::cout << rune::vt100::show_cursor; */
+}
+
+connection& downloader::add_connection(transfer &t, connection::kind type, size_t mirror,
+        curl_off_t offset, curl_off_t last)
+{
+    t.connections.emplace_back(std::make_unique<connection>(t, type, mirror));
+    connection &c = *t.connections.back();
+    c.first = c.offset = offset;
+    c.last = last;
+
+    CURL *curl = c.handle = curl_easy_init();
     if (!curl) throw component_error("curl could not initialize");
 
+    curl_easy_setopt(curl, CURLOPT_URL, t.uris[mirror].c_str());
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(curl, CURLOPT_USERAGENT,
            "Mozilla/5.0 (X11; Linux x86_64; rv:57.0) Gecko/20100101 Firefox/57.0");
@@ -49,13 +164,12 @@ downloader::downloader(string download_dir)
     /* Consider HTTP codes >=400 as errors. This option is NOT fail-safe. */
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
 
-    /* Set callback function for writing data. */
-    /* curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, downloader::write_data); */
+    /* Everything received is written at the connection's offset. */
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, downloader::write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &c);
 
-    /* Set callback function for progress metering. */
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, downloader::progress_callback);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
+    /* So that we know which connection a finished handle belongs to. */
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &c);
 
     /*
      * Assume there is a connection error and abort transfer with CURLE_OPERATION_TIMEDOUT
@@ -68,29 +182,166 @@ downloader::downloader(string download_dir)
     /* curl_easy_setopt(curl, CURLOPT_VERBOSE, 1); */
     /* curl_easy_setopt(curl,CURLOPT_MAX_RECV_SPEED_LARGE, 1024 * 50); */
 
-    /* std::cout << rune::vt100::hide_cursor; */
+    switch (type) {
+        case connection::kind::probe:
+            /*
+             * Ask for the start of the file: a mirror that serves byte ranges tells us the
+             * full size in its answer, and we get to see how fast it is. Don't wait forever.
+             */
+            curl_easy_setopt(curl, CURLOPT_RANGE, fmt::format("0-{}", probe_size - 1).c_str());
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15);
+            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, downloader::header_callback);
+            curl_easy_setopt(curl, CURLOPT_HEADERDATA, &c);
+            break;
+        case connection::kind::segment:
+            curl_easy_setopt(curl, CURLOPT_RANGE, fmt::format("{}-{}", offset, last).c_str());
+            break;
+        case connection::kind::whole:
+            /* Continue where we left off, if anywhere. */
+            curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, offset);
+            break;
+    }
+
+    if (CURLMcode res = curl_multi_add_handle(multi, curl); res != CURLM_OK) {
+        drop_connection(c);
+        throw component_error(fmt::format("curl could not add a transfer: {}", curl_multi_strerror(res)));
+    }
+
+    return c;
 }
 
-downloader::~downloader()
+void downloader::drop_connection(connection &c)
 {
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    curl_multi_remove_handle(multi, c.handle);
+    curl_easy_cleanup(c.handle);
 
-    /* std::cout << rune::vt100::show_cursor; */
+    if (c.type != connection::kind::probe)
+        c.owner.progress.add(c.first, c.offset);
+
+    auto &conns = c.owner.connections;
+    conns.erase(std::find_if(conns.begin(), conns.end(), [&c](const auto &p) {
+        return p.get() == &c;
+    }));
+}
+
+size_t downloader::write_callback(char *data, size_t size, size_t nmemb, void *userp)
+{
+    connection *c = static_cast<connection*>(userp);
+    transfer &t = c->owner;
+    size_t length = size * nmemb;
+
+    if (c->type == connection::kind::probe) {
+        /*
+         * We only measure the probe; the data is fetched again by whichever connection
+         * ends up downloading it. If the mirror ignored our range and sends the whole
+         * file instead, we stop it once we have seen enough.
+         */
+        c->offset += length;
+        return c->offset > probe_size ? 0 : length;
+    }
+
+    if (c->type == connection::kind::segment) {
+        /*
+         * If the server ignored our range it sends the file from its start,
+         * which we must not write at the segment's offset.
+         */
+        long code;
+        if (curl_easy_getinfo(c->handle, CURLINFO_RESPONSE_CODE, &code) != CURLE_OK || code != 206)
+            return 0;
+
+        /* More than we asked for; the server is misbehaving. */
+        if (c->offset + static_cast<curl_off_t>(length) > c->last + 1)
+            return 0;
+    }
+
+    if (t.size < 0) {
+        /* The probe couldn't tell us; perhaps the response can. */
+        curl_off_t cl;
+        if (curl_easy_getinfo(c->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &cl) == CURLE_OK && cl > 0)
+            t.size = cl;
+    }
+
+    for (size_t left = length; left > 0;) {
+        const ssize_t n = pwrite(t.fd, data, left, c->offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        data += n;
+        left -= n;
+        c->offset += n;
+        t.written += n;
+    }
+
+    return length;
+}
+
+size_t downloader::header_callback(char *data, size_t size, size_t nitems, void *userp)
+{
+    connection *c = static_cast<connection*>(userp);
+    const size_t length = size * nitems;
+    const string header(data, length);
+
+    /* With redirects we'll see several responses; only the last one counts. */
+    if (header.compare(0, 5, "HTTP/") == 0) {
+        c->total = -1;
+        c->etag.clear();
+        c->last_modified.clear();
+        return length;
+    }
+
+    const auto colon = header.find(':');
+    if (colon == string::npos)
+        return length;
+
+    /* Field names are case-insensitive, but their values need not be. */
+    string name = header.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    const auto value_start = header.find_first_not_of(" \t", colon + 1),
+               value_end = header.find_last_not_of(" \t\r\n");
+    const string value = value_start <= value_end ?
+        header.substr(value_start, value_end - value_start + 1) : "";
+
+    if (name == "content-range") {
+        /* On the form "bytes 0-65535/1048576"; the total may be "*" if unknown. */
+        if (const auto slash = value.rfind('/'); slash != string::npos) {
+            try {
+                c->total = std::stoll(value.substr(slash + 1));
+            } catch (const std::exception&) {
+                c->total = -1;
+            }
+        }
+    } else if (name == "etag")
+        c->etag = value;
+    else if (name == "last-modified")
+        c->last_modified = value;
+
+    return length;
 }
 
 fs::path downloader::generate_filename(const bookwyrm::item &item)
 {
     const fs::path base = dldir / fmt::format("{} - {} ({})",
-            utils::vector_to_string(item.nonexacts.authors),
-            item.nonexacts.title, item.exacts.year);
+            utils::vector_to_string(item.nonexacts().authors()),
+            string(item.nonexacts().title()), item.exacts().year());
+
+    /* A file is free to use if it doesn't exist, or if it's an unfinished download. */
+    const auto valid_candidate = [this](fs::path p) {
+        if (claimed_.find(p) != claimed_.cend())
+            return false;
 
-    const auto valid_candidate = [](fs::path p) {
-        return !fs::exists(p);
+        if (!fs::exists(p) || fs::exists(journal::path_for(p))) {
+            claimed_.insert(p);
+            return true;
+        }
+
+        return false;
     };
 
     /* If filename.ext doesn't exists, we use that. */
-    if (auto candidate = base; valid_candidate(candidate.concat("." + item.exacts.extension)))
+    if (auto candidate = base; valid_candidate(candidate.concat("." + string(item.exacts().extension()))))
         return candidate;
 
     /*
@@ -110,137 +361,871 @@ fs::path downloader::generate_filename(const bookwyrm::item &item)
 
     do {
         candidate = base;
-        candidate.concat(fmt::format(".{}.{}", ++i, item.exacts.extension));
+        candidate.concat(fmt::format(".{}.{}", ++i, string(item.exacts().extension())));
     } while (!valid_candidate(candidate));
 
     return candidate;
 }
 
-bool downloader::sync_download(vector<bookwyrm::item> items)
+void downloader::start(transfer &t)
 {
-    bool any_success = false;
+    t.filename = generate_filename(t.item);
 
-    for (const auto &item : items) {
-        auto filename = generate_filename(item);
-        bool success = false;
+    /*
+     * Create the file right away, even though nothing may be written to it for a while.
+     * Otherwise another transfer might generate the same filename.
+     */
+    t.fd = open(t.filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (t.fd < 0) {
+        /* TODO: test this output */
+        throw component_error(fmt::format("unable to create this file: {}; reason: {}",
+                    t.filename.string(), std::strerror(errno)));
+    }
 
-        int mirror = 1;
-        for (const auto &url : item.misc.uris) {
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    /* Did a previous run leave anything behind? */
+    if (auto previous = journal::load(t.filename); previous)
+        t.progress = *previous;
 
-            std::FILE *out = std::fopen(filename.c_str(), "wb");
-            if (out == NULL) {
-                /* TODO: test this output */
-                throw component_error(fmt::format("unable to create this file: {}; reason: {}",
-                            filename.string(), std::strerror(errno)));
-            }
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, out);
+    if (t.uris.empty()) {
+        finish(t, false);
+        return;
+    }
 
-            if (CURLcode res = curl_easy_perform(curl); res != CURLE_OK) {
-                fmt::print(stderr, "{}error: item download (mirror {}) failed: {} (CURLcode = {})\n",
-                        rune::vt100::erase_line, mirror++, curl_easy_strerror(res), res);
+    /* Race all mirrors against each other, so that we may pick the fastest, or use them all. */
+    t.state = transfer::status::probing;
+    t.mirrors.resize(t.uris.size());
+    for (size_t mirror = 0; mirror < t.uris.size(); mirror++)
+        add_connection(t, connection::kind::probe, mirror);
 
-                std::fclose(out);
-                if (fs::file_size(filename) == 0)
-                    fs::remove(filename);
+    /* If we have seen every host before, we can tell which one will likely win. */
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t mirror = 0; mirror < t.uris.size(); mirror++) {
+        const auto host = hosts_.find(host_of(t.uris[mirror]));
+        if (host == hosts_.cend()) {
+            t.favourite.reset();
+            break;
+        }
 
-            } else {
-                std::fclose(out);
-                any_success = success = true;
+        if (const double s = score(host->second.ttfb, host->second.throughput, -1); s < best) {
+            best = s;
+            t.favourite = mirror;
+        }
+    }
+}
 
-                /* That source worked, so there is no need to download from the others. */
-                break;
-            }
+double downloader::score(double ttfb, double throughput, curl_off_t size)
+{
+    /* Without a size to go by, judge the mirror by how long a typical book would take. */
+    constexpr curl_off_t typical_size = 8 * 1024 * 1024;
+
+    if (throughput <= 0)
+        return std::numeric_limits<double>::infinity();
+
+    return ttfb + (size > 0 ? size : typical_size) / throughput;
+}
+
+void downloader::record_speed(const string &url, double ttfb, double throughput)
+{
+    /* Newer measurements weigh as much as all earlier ones together. */
+    constexpr double weight = 0.5;
+
+    auto &h = hosts_[host_of(url)];
+    if (h.samples++ == 0) {
+        h.ttfb = std::max(ttfb, 0.0);
+        h.throughput = throughput;
+    } else {
+        if (ttfb >= 0) h.ttfb = weight * ttfb + (1 - weight) * h.ttfb;
+        h.throughput = weight * throughput + (1 - weight) * h.throughput;
+    }
+}
+
+void downloader::on_probe_done(connection &c, CURLcode res)
+{
+    transfer &t = c.owner;
+    auto &info = t.mirrors[c.mirror];
+    info.answered = true;
+
+    /* A mirror sending the whole file is cut off by us once we have seen enough of it. */
+    if (res == CURLE_OK || (res == CURLE_WRITE_ERROR && c.offset > probe_size)) {
+        long code = 0;
+        curl_easy_getinfo(c.handle, CURLINFO_RESPONSE_CODE, &code);
+
+        info.ok = true;
+        info.accepts_ranges = code == 206 && c.total > 0;
+        info.etag = c.etag;
+        info.last_modified = c.last_modified;
+
+        if (info.accepts_ranges)
+            info.length = c.total;
+        else if (curl_easy_getinfo(c.handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &info.length) != CURLE_OK)
+            info.length = -1;
+
+        /* The time to the first byte includes any redirects, which we'd have to follow again. */
+        double ttfb = 0, total = 0;
+        curl_easy_getinfo(c.handle, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+        curl_easy_getinfo(c.handle, CURLINFO_TOTAL_TIME, &total);
+        info.ttfb = ttfb;
+        info.throughput = c.offset / std::max(total - ttfb, 0.001);
+
+        record_speed(t.uris[c.mirror], info.ttfb, info.throughput);
+    }
+
+    drop_connection(c);
+
+    if (t.connections.empty() || (info.ok && t.favourite == c.mirror)) {
+        decide(t);
+    } else if (info.ok && !t.race_started) {
+        t.race_started.emplace();
+    }
+}
+
+void downloader::decide(transfer &t)
+{
+    /* Whoever hasn't answered yet is too slow to be of much use. */
+    while (!t.connections.empty())
+        drop_connection(*t.connections.back());
+
+    /*
+     * Rank the mirrors: those that answered by how fast they were, then those we cancelled
+     * by how fast they were before (if at all), and last those that failed. Within each
+     * group, mirrors we know nothing about keep the order they were given in.
+     */
+    const auto rank = [this, &t](size_t mirror) -> std::pair<int, double> {
+        const auto &m = t.mirrors[mirror];
+        if (m.ok)
+            return {0, score(m.ttfb, m.throughput, m.length)};
+        if (m.answered)
+            return {2, 0};
+
+        const auto host = hosts_.find(host_of(t.uris[mirror]));
+        return {1, host != hosts_.cend() ?
+            score(host->second.ttfb, host->second.throughput, -1) : std::numeric_limits<double>::infinity()};
+    };
+
+    t.order.resize(t.mirrors.size());
+    std::iota(t.order.begin(), t.order.end(), 0);
+    std::stable_sort(t.order.begin(), t.order.end(), [&rank](size_t a, size_t b) {
+        return rank(a) < rank(b);
+    });
+
+    t.attempt = 0;
+    t.race_started.reset();
+
+    /*
+     * The fastest mirror that serves byte ranges decides the file's size, and any other
+     * mirror serving ranges of a file with that very same size is assumed to serve the
+     * same file. Faster mirrors are handed segments first.
+     */
+    const auto first = std::find_if(t.order.cbegin(), t.order.cend(), [&t](size_t mirror) {
+        const auto &m = t.mirrors[mirror];
+        return m.ok && m.accepts_ranges && m.length > 0;
+    });
+
+    vector<size_t> sources;
+    if (first != t.order.cend()) {
+        for (size_t mirror : t.order) {
+            const auto &m = t.mirrors[mirror];
+            if (m.ok && m.accepts_ranges && m.length == t.mirrors[*first].length)
+                sources.push_back(mirror);
+        }
+    }
+
+    if (sources.empty() || !start_segmented(t, sources))
+        start_single(t);
+}
+
+bool downloader::resumable(const transfer &t, size_t mirror) const
+{
+    const auto &m = t.mirrors[mirror];
+    const auto &j = t.progress;
+
+    if (j.ranges.empty() || !m.ok || !m.accepts_ranges || m.length != j.size)
+        return false;
+
+    /*
+     * Another mirror serving a file of the same size is assumed to serve the same file,
+     * just like when downloading segments.
+     */
+    if (j.url != t.uris[mirror])
+        return true;
+
+    /* Same mirror: has the file changed since? */
+    if (!j.etag.empty() && !m.etag.empty())
+        return j.etag == m.etag;
+    if (!j.last_modified.empty() && !m.last_modified.empty())
+        return j.last_modified == m.last_modified;
+
+    return true;
+}
+
+void downloader::adopt_mirror(transfer &t, size_t mirror)
+{
+    const auto &m = t.mirrors[mirror];
+
+    if (!resumable(t, mirror)) {
+        t.progress = journal();
+
+        /* Whatever we had is of no use. */
+        if (ftruncate(t.fd, 0) != 0) {
+            throw component_error(fmt::format("unable to truncate this file: {}; reason: {}",
+                        t.filename.string(), std::strerror(errno)));
+        }
+    }
+
+    t.progress.url = t.uris[mirror];
+    t.progress.size = m.length;
+    t.progress.etag = m.etag;
+    t.progress.last_modified = m.last_modified;
+
+    t.size = m.length;
+    t.written = t.progress.bytes();
+}
+
+bool downloader::start_segmented(transfer &t, const vector<size_t> &sources)
+{
+    const curl_off_t size = t.mirrors[sources.front()].length;
+
+    /* Not worth the hassle. */
+    if (max_segments_ < 2 || size / min_segment_size < 2)
+        return false;
+
+    adopt_mirror(t, sources.front());
+
+    /*
+     * Reserve the space up front, so that the segments can be written where they
+     * belong and so that we don't run out of space halfway through.
+     */
+    if (int err = posix_fallocate(t.fd, 0, size); err != 0) {
+        if (err == ENOSPC || ftruncate(t.fd, size) != 0)
+            return false;
+    }
+
+    t.state = transfer::status::segmented;
+
+    /*
+     * Fetch whatever we are missing. Split the largest missing ranges in
+     * halves until we have enough segments, or until they become too small.
+     */
+    auto segments = t.progress.missing();
+    while (!segments.empty() && segments.size() < static_cast<size_t>(max_segments_)) {
+        auto largest = std::max_element(segments.begin(), segments.end(), [](const auto &a, const auto &b) {
+            return a.second - a.first < b.second - b.first;
+        });
+
+        const auto [first, last] = *largest;
+        if (last - first < 2 * min_segment_size)
+            break;
+
+        const auto middle = first + (last - first) / 2;
+        largest->second = middle;
+        segments.insert(std::next(largest), {middle, last});
+    }
+
+    if (segments.empty()) {
+        /* We already have all of it. */
+        finish(t, true);
+        return true;
+    }
+
+    /* Spread the segments over all mirrors. */
+    for (size_t i = 0; i < segments.size(); i++) {
+        const auto [first, last] = segments[i];
+        add_connection(t, connection::kind::segment, sources[i % sources.size()], first, last - 1);
+    }
+
+    return true;
+}
+
+void downloader::on_segment_done(connection &c, CURLcode res)
+{
+    transfer &t = c.owner;
+
+    if (res == CURLE_OK && c.offset == c.last + 1) {
+        curl_off_t speed;
+        if (curl_easy_getinfo(c.handle, CURLINFO_SPEED_DOWNLOAD_T, &speed) == CURLE_OK && speed > 0)
+            record_speed(t.uris[c.mirror], -1, speed);
+
+        drop_connection(c);
+        if (t.connections.empty())
+            finish(t, true);
+        return;
+    }
+
+    report(spdlog::level::err, fmt::format("segment download (mirror {}) failed: {} (CURLcode = {})",
+            c.mirror + 1, res == CURLE_OK ? "transfer ended early" : curl_easy_strerror(res), res));
+
+    /* Fetch the rest of the range from the fastest mirror this segment hasn't failed on yet, if any. */
+    vector<size_t> failed = c.failed_mirrors;
+    failed.push_back(c.mirror);
+
+    for (size_t mirror : t.order) {
+        const auto &m = t.mirrors[mirror];
+        const bool source = m.ok && m.accepts_ranges && m.length == t.size;
+
+        if (source && std::find(failed.cbegin(), failed.cend(), mirror) == failed.cend()) {
+            const curl_off_t offset = c.offset, last = c.last;
+            drop_connection(c);
+            save_journal(t);
+
+            add_connection(t, connection::kind::segment, mirror, offset, last).failed_mirrors = failed;
+            return;
         }
+    }
+
+    /* No mirror could serve this segment; continue with a single stream instead. */
+    while (!t.connections.empty())
+        drop_connection(*t.connections.back());
+
+    save_journal(t);
+    t.attempt = 0;
+    start_single(t);
+}
+
+void downloader::start_single(transfer &t)
+{
+    t.state = transfer::status::single;
+
+    if (t.attempt >= t.order.size()) {
+        finish(t, false);
+        return;
+    }
+
+    t.mirror = t.order[t.attempt];
+    adopt_mirror(t, t.mirror);
+
+    /*
+     * A single stream can only continue from the end of what we have from
+     * the start of the file. Anything after that is written over anyway.
+     */
+    const curl_off_t resume_from = t.progress.prefix();
+    if (resume_from > 0 && resume_from == t.size) {
+        finish(t, true);
+        return;
+    }
+
+    if (ftruncate(t.fd, resume_from) != 0) {
+        throw component_error(fmt::format("unable to truncate this file: {}; reason: {}",
+                    t.filename.string(), std::strerror(errno)));
+    }
+
+    t.progress.ranges.clear();
+    t.progress.add(0, resume_from);
+    t.written = resume_from;
+
+    add_connection(t, connection::kind::whole, t.mirror, resume_from);
+}
+
+void downloader::on_whole_done(connection &c, CURLcode res)
+{
+    transfer &t = c.owner;
+    const bool resumed = c.first > 0;
+
+    if (curl_off_t speed; res == CURLE_OK &&
+            curl_easy_getinfo(c.handle, CURLINFO_SPEED_DOWNLOAD_T, &speed) == CURLE_OK && speed > 0)
+        record_speed(t.uris[c.mirror], -1, speed);
+
+    drop_connection(c);
+
+    if (res == CURLE_OK) {
+        finish(t, true);
+        return;
+    }
+
+    report(spdlog::level::err, fmt::format("item download (mirror {}) failed: {} (CURLcode = {})",
+            t.mirror + 1, curl_easy_strerror(res), res));
+
+    if (res == CURLE_RANGE_ERROR && resumed) {
+        /* The mirror wouldn't let us resume; try it again from the start. */
+        t.progress.ranges.clear();
+    } else {
+        /* Try the next fastest mirror, if any. */
+        save_journal(t);
+        t.attempt++;
+    }
+
+    start_single(t);
+}
+
+void downloader::save_journal(const transfer &t)
+{
+    /* Running connections have written more than what's been recorded. */
+    journal j = t.progress;
+    for (const auto &c : t.connections) {
+        if (c->type != connection::kind::probe)
+            j.add(c->first, c->offset);
+    }
+
+    /* Nothing worth resuming. */
+    if (j.ranges.empty() || j.size <= 0)
+        return;
+
+    j.save(t.filename);
+}
+
+void downloader::finish(transfer &t, bool success)
+{
+    t.state = success ? transfer::status::done : transfer::status::failed;
+    close(t.fd);
+    t.fd = -1;
+
+    if (success) {
+        journal::remove(t.filename);
+
+        any_success_ = true;
+        report(spdlog::level::info, fmt::format("done: {}", t.filename.filename().string()));
+        return;
+    }
+
+    /* Keep what we have, so that a later run may continue from it. */
+    if (fs::file_size(t.filename) == 0) {
+        fs::remove(t.filename);
+        journal::remove(t.filename);
+    } else {
+        save_journal(t);
+    }
+
+    report(spdlog::level::err, fmt::format("no good sources for this item: {} - {} ({}). Sorry!",
+        utils::vector_to_string(t.item.nonexacts().authors()),
+        string(t.item.nonexacts().title()), t.item.exacts().year()));
+}
+
+bool downloader::sync_download(vector<bookwyrm::item> &&items)
+{
+    /* Forget about any earlier batch; they have all finished. */
+    {
+        std::lock_guard<std::mutex> guard(queue_mutex_);
+        status_.clear();
+    }
+    transfers_.clear();
+    any_success_ = false;
+
+    for (size_t id = 0; id < items.size(); id++)
+        enqueue(id, std::move(items[id]));
+
+    closing_ = true;
+    run();
+
+    return any_success_;
+}
+
+void downloader::async_download(logger_t logger, std::function<void()> on_update)
+{
+    {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        logger_ = logger;
+        on_update_ = on_update;
+    }
+
+    quiet_ = true;
+
+    worker_ = std::thread([this]() {
+        try {
+            run();
+        } catch (...) {
+            /* Nobody is listening; leave it for wait(). */
+            error_ = std::current_exception();
+        }
+    });
+}
+
+void downloader::enqueue(size_t id, const bookwyrm::item &item)
+{
+    /* The item, and the pool some of its strings are in, are someone else's: take a copy of it, to keep. */
+    enqueue(id, bookwyrm::item(item));
+}
+
+void downloader::enqueue(size_t id, bookwyrm::item &&item)
+{
+    std::lock_guard<std::mutex> guard(queue_mutex_);
+
+    /* Already on its way. */
+    if (status_.find(id) != status_.cend())
+        return;
+
+    incoming_.emplace_back(id, std::move(item));
+    status_.emplace(id, download_status());
+    requested_.notify_one();
+}
+
+void downloader::cancel(size_t id)
+{
+    std::lock_guard<std::mutex> guard(queue_mutex_);
+
+    const auto status = status_.find(id);
+    if (status == status_.cend() || status->second.state == transfer::status::done)
+        return;
+
+    status_.erase(status);
+
+    /* Not picked up yet? Then there is nothing to stop. */
+    const auto pending = std::find_if(incoming_.begin(), incoming_.end(), [id](const auto &p) {
+        return p.first == id;
+    });
+
+    if (pending != incoming_.end()) {
+        incoming_.erase(pending);
+    } else {
+        cancelled_.push_back(id);
+        requested_.notify_one();
+    }
+}
+
+std::optional<download_status> downloader::status(size_t id) const
+{
+    std::lock_guard<std::mutex> guard(queue_mutex_);
+
+    if (const auto status = status_.find(id); status != status_.cend())
+        return status->second;
+
+    return std::nullopt;
+}
+
+void downloader::detach()
+{
+    std::lock_guard<std::mutex> guard(report_mutex_);
+    logger_.reset();
+    on_update_ = nullptr;
+}
+
+bool downloader::wait()
+{
+    detach();
+
+    {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        quiet_ = false;
+
+        for (const auto &[level, msg] : held_back_)
+            fmt::print(level >= spdlog::level::err ? stderr : stdout, "{}{}\n",
+                    level >= spdlog::level::err ? "error: " : "", msg);
+        held_back_.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queue_mutex_);
+        closing_ = true;
+        requested_.notify_one();
+    }
+
+    if (worker_.joinable())
+        worker_.join();
 
-        if (!success) {
-            fmt::print(stderr, "error: no good sources for this item: {} - {} ({}). Sorry!\n",
-                utils::vector_to_string(item.nonexacts.authors),
-                item.nonexacts.title, item.exacts.year);
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+
+    return any_success_;
+}
+
+void downloader::cancel_all()
+{
+    detach();
+
+    {
+        std::lock_guard<std::mutex> guard(queue_mutex_);
+        for (const auto &[id, status] : status_) {
+            if (status.state != transfer::status::done)
+                cancelled_.push_back(id);
         }
+
+        closing_ = true;
+        requested_.notify_one();
     }
 
-    return any_success;
+    if (worker_.joinable())
+        worker_.join();
 }
 
-int downloader::progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+void downloader::report(spdlog::level::level_enum level, const string &msg)
 {
-    /* We never upload anything. */
-    (void)ulnow;
-    (void)ultotal;
+    std::lock_guard<std::mutex> guard(report_mutex_);
+
+    if (!quiet_) {
+        clear_progress();
+        fmt::print(level >= spdlog::level::err ? stderr : stdout, "{}{}\n",
+                level >= spdlog::level::err ? "error: " : "", msg);
+    } else if (logger_) {
+        logger_->log(level, msg);
+    } else {
+        held_back_.emplace_back(level, msg);
+    }
+}
+
+void downloader::take_requests()
+{
+    std::lock_guard<std::mutex> guard(queue_mutex_);
 
     /*
-     * dltotal: the size of the file being downloaded (in bytes)
-     * dlnow:   how much have been downloaded thus far (in bytes)
+     * Cancellations first: an item may have been cancelled and then enqueued
+     * again, in which case the old transfer must go before the new one arrives.
      */
-    downloader *d = static_cast<downloader*>(clientp);
-
-    double rate;
-    if (curl_easy_getinfo(d->curl, CURLINFO_SPEED_DOWNLOAD, &rate) != CURLE_OK)
-        rate = std::numeric_limits<double>::quiet_NaN();
-
-    if (d->timer.ms_since_last_update() >= 100 || dlnow == dltotal) {
-        d->timer.reset();
-
-        time::duration eta((dltotal - dlnow) / rate);
-        std::stringstream eta_ss;
-        if (eta.hours() > 0) {
-            eta_ss << eta.hours() << "h "
-                   << std::setfill('0') << std::setw(2) << eta.minutes() << "m "
-                   << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
-        } else if (eta.minutes() > 0) {
-            eta_ss << eta.minutes() << "m "
-                   << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
-        } else {
-            eta_ss << eta.seconds() << "s";
+    for (size_t id : cancelled_) {
+        const auto it = std::find_if(transfers_.begin(), transfers_.end(), [id](const auto &t) {
+            return t->id == id;
+        });
+        if (it == transfers_.end()) continue;
+
+        transfer &t = **it;
+        if (t.state == transfer::status::done) {
+            /* Too late; keep showing it for what it is. */
+            status_[id] = {t.state, t.written, t.size};
+            continue;
         }
 
-        /* Download rate unit conversion. */
-        const string rate_unit = [&rate]() {
-            constexpr auto k = 1024,
-                           M = 1048576;
+        while (!t.connections.empty())
+            drop_connection(*t.connections.back());
 
-            if (rate > M) {
-                rate /= M;
-                return "MB/s";
+        /* Keep what we have, like when we fail. */
+        if (t.fd >= 0) {
+            close(t.fd);
+            if (fs::file_size(t.filename) == 0) {
+                fs::remove(t.filename);
+                journal::remove(t.filename);
             } else {
-                rate /= k;
-                return "kB/s";
+                save_journal(t);
             }
-        }();
+        }
 
-        const double fraction = static_cast<double>(dlnow) / static_cast<double>(dltotal);
-        fmt::print("{}\r  {:.0f}% ", rune::vt100::erase_line, fraction * 100);
-
-        string status_text = fmt::format(" {dlnow:.2f}/{dltotal:.2f}MB @ {rate:.2f}{unit} ETA: {eta}\r",
-                fmt::arg("dlnow",   static_cast<double>(dlnow)/1024/1024),
-                fmt::arg("dltotal", static_cast<double>(dltotal)/1024/1024),
-                fmt::arg("rate",    rate),
-                fmt::arg("unit",    rate_unit),
-                fmt::arg("eta",     eta_ss.str()));
-
-        /* Draw the progress bar. */
-        const int term_width = []() {
-            struct winsize w;
-            ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-            return w.ws_col;
-        }();
+        claimed_.erase(t.filename);
+        transfers_.erase(it);
+    }
+    cancelled_.clear();
+
+    for (auto &[id, item] : incoming_) {
+        /* Only a finished transfer can have outlived its cancellation. */
+        const bool finished = std::any_of(transfers_.cbegin(), transfers_.cend(), [id = id](const auto &t) {
+            return t->id == id;
+        });
+
+        if (!finished)
+            transfers_.emplace_back(std::make_unique<transfer>(id, std::move(item)));
+    }
+    incoming_.clear();
+}
+
+void downloader::publish_status()
+{
+    bool changed = false;
+
+    {
+        std::lock_guard<std::mutex> guard(queue_mutex_);
+
+        for (const auto &t : transfers_) {
+            const auto status = status_.find(t->id);
+            if (status == status_.end()) continue;
+
+            auto &s = status->second;
+            changed = changed || s.state != t->state || s.written != t->written || s.size != t->size;
+            s = {t->state, t->written, t->size};
+        }
+    }
+
+    if (!changed) return;
+
+    std::lock_guard<std::mutex> guard(report_mutex_);
+    if (on_update_)
+        on_update_();
+}
+
+void downloader::run()
+{
+    const auto active = [](const transfer &t) {
+        return t.state != transfer::status::queued && t.state != transfer::status::done &&
+            t.state != transfer::status::failed;
+    };
+
+    for (;;) {
+        take_requests();
+
+        /* Start new transfers until we have reached our limit. */
+        auto running = std::count_if(transfers_.cbegin(), transfers_.cend(), [&active](const auto &t) {
+            return active(*t);
+        });
+        for (auto &t : transfers_) {
+            if (running >= max_transfers_) break;
+            if (t->state != transfer::status::queued) continue;
+
+            start(*t);
+            running += active(*t);
+        }
+
+        if (running == 0) {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (closing_ && incoming_.empty())
+                break;
+
+            /*
+             * Nothing to transfer, so nothing for curl to wait on either: sleep until
+             * we are handed more, rather than spin. Let the world know where we are first.
+             */
+            if (incoming_.empty() && cancelled_.empty()) {
+                lock.unlock();
+                publish_status();
+                lock.lock();
+
+                requested_.wait(lock, [this]() {
+                    return closing_ || !incoming_.empty() || !cancelled_.empty();
+                });
+            }
+
+            continue;
+        }
+
+        int still_running;
+        if (CURLMcode res = curl_multi_perform(multi, &still_running); res != CURLM_OK)
+            throw component_error(fmt::format("curl failed to perform transfers: {}", curl_multi_strerror(res)));
+
+        /* Handle the connections that finished, successfully or not. */
+        int msgs_left;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &msgs_left)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            connection *c;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &c);
+            const CURLcode res = msg->data.result;
+
+            switch (c->type) {
+                case connection::kind::probe:
+                    on_probe_done(*c, res);
+                    break;
+                case connection::kind::whole:
+                    on_whole_done(*c, res);
+                    break;
+                case connection::kind::segment:
+                    on_segment_done(*c, res);
+                    break;
+            }
+        }
+
+        /* End the races whose slower mirrors have had their chance. */
+        for (auto &t : transfers_) {
+            if (t->state == transfer::status::probing && t->race_started &&
+                    t->race_started->ms_since_last_update() >= race_grace)
+                decide(*t);
+        }
+
+        /* Don't lose more than a second's worth of data if we are interrupted. */
+        if (journal_timer_.ms_since_last_update() >= 1000) {
+            journal_timer_.reset();
+            for (const auto &t : transfers_) {
+                if (!t->connections.empty())
+                    save_journal(*t);
+            }
+        }
+
+        if (status_timer_.ms_since_last_update() >= 100) {
+            status_timer_.reset();
+            publish_status();
+        }
+
+        if (!quiet_ && timer.ms_since_last_update() >= 100) {
+            timer.reset();
+            std::lock_guard<std::mutex> guard(report_mutex_);
+            draw_progress();
+        }
+
+        curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+    }
+
+    publish_status();
+
+    if (!quiet_ && !transfers_.empty()) {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        draw_progress();
+
+        /* Leave the final progress on screen. */
+        progress_lines_ = 0;
+    }
+}
+
+void downloader::clear_progress()
+{
+    if (quiet_) return;
+
+    for (; progress_lines_ > 0; progress_lines_--)
+        std::cout << rune::vt100::prev_line;
+
+    std::cout << rune::vt100::erase_down << std::flush;
+}
+
+void downloader::draw_progress()
+{
+    clear_progress();
+
+    const int term_width = terminal_width();
+
+    /* Draw a line on the form "  42% [====    ] status". */
+    const auto draw_line = [this, term_width](curl_off_t dlnow, curl_off_t dltotal, string status) {
+        const double fraction = dltotal > 0 ?
+            static_cast<double>(dlnow) / static_cast<double>(dltotal) : 0.0;
 
         int bar_length = 26,
             min_bar_length = 5,
-            status_text_length = status_text.length() + 6;
+            status_text_length = status.length() + 6;
 
         if (status_text_length + bar_length > term_width)
             bar_length -= status_text_length + bar_length - term_width;
 
+        /* Truncate the status if not even that fits. */
+        if (status_text_length > term_width && term_width > 6)
+            status.resize(term_width - 6);
+
+        fmt::print("  {:3.0f}% ", fraction * 100);
+
         /* Don't draw the progress bar if length is less than min_bar_length. */
         if (bar_length >= min_bar_length)
-            d->pbar.draw(bar_length, fraction);
+            pbar.draw(bar_length, fraction);
+
+        std::cout << status << '\n';
+        progress_lines_++;
+    };
 
-        std::cout << status_text << std::flush;
+    constexpr auto MB = 1024.0 * 1024.0;
+    curl_off_t total_now = 0, total_size = 0;
+    double total_rate = 0;
+    size_t done = 0;
+
+    for (const auto &t : transfers_) {
+        if (t->state == transfer::status::done || t->state == transfer::status::failed)
+            done++;
+
+        if (t->state == transfer::status::failed) continue;
+
+        total_now += t->written;
+        total_size += std::max<curl_off_t>(t->size, 0);
+
+        if (t->connections.empty()) continue;
+
+        /* All connections of a transfer together make up its rate. */
+        double rate = 0;
+        for (const auto &c : t->connections) {
+            curl_off_t speed;
+            if (curl_easy_getinfo(c->handle, CURLINFO_SPEED_DOWNLOAD_T, &speed) == CURLE_OK)
+                rate += speed;
+        }
+        total_rate += rate;
+
+        const string how = [&t]() -> string {
+            switch (t->state) {
+                case transfer::status::probing:
+                    return " (racing mirrors)";
+                case transfer::status::segmented:
+                    return fmt::format(" ({} segments)", t->connections.size());
+                default:
+                    return "";
+            }
+        }();
+
+        draw_line(t->written, t->size, fmt::format(" {:.2f}/{:.2f}MB @ {} {}{}",
+                    t->written / MB, std::max<curl_off_t>(t->size, 0) / MB, format_rate(rate),
+                    t->filename.filename().string(), how));
     }
 
-    return 0;
+    const string eta = total_rate > 0 ? format_eta((total_size - total_now) / total_rate) : "?";
+    draw_line(total_now, total_size, fmt::format(" {}/{} items, {:.2f}/{:.2f}MB @ {} ETA: {}",
+                done, transfers_.size(), total_now / MB, total_size / MB,
+                format_rate(total_rate), eta));
+
+    std::cout << std::flush;
 }
 
 string progressbar::build_bar(unsigned int length, double fraction)
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "components/journal.hpp"
+
+namespace bookwyrm {
+
+fs::path journal::path_for(const fs::path &file)
+{
+    auto path = file;
+    return path.concat(".journal");
+}
+
+std::optional<journal> journal::load(const fs::path &file)
+{
+    std::ifstream in(path_for(file));
+    if (!in)
+        return std::nullopt;
+
+    journal j;
+    string line;
+
+    while (std::getline(in, line)) {
+        const auto sep = line.find(' ');
+        if (sep == string::npos) continue;
+
+        const string key = line.substr(0, sep),
+                     value = line.substr(sep + 1);
+
+        try {
+            if (key == "url") {
+                j.url = value;
+            } else if (key == "etag") {
+                j.etag = value;
+            } else if (key == "last-modified") {
+                j.last_modified = value;
+            } else if (key == "size") {
+                j.size = std::stoll(value);
+            } else if (key == "range") {
+                std::istringstream ss(value);
+                int64_t first, last;
+                if (ss >> first >> last)
+                    j.add(first, last);
+            }
+        } catch (const std::exception&) {
+            /* A mangled journal is as good as none. */
+            return std::nullopt;
+        }
+    }
+
+    /* We can't resume anything of unknown size. */
+    if (j.url.empty() || j.size <= 0)
+        return std::nullopt;
+
+    return j;
+}
+
+void journal::save(const fs::path &file) const
+{
+    /* Write to a temporary file first, so that we never leave half a journal behind. */
+    auto tmp = path_for(file);
+    tmp.concat(".tmp");
+
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) return;
+
+        out << "url " << url << '\n'
+            << "size " << size << '\n';
+
+        if (!etag.empty())
+            out << "etag " << etag << '\n';
+        if (!last_modified.empty())
+            out << "last-modified " << last_modified << '\n';
+
+        for (const auto &[first, last] : ranges)
+            out << "range " << first << ' ' << last << '\n';
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path_for(file), ec);
+}
+
+void journal::remove(const fs::path &file)
+{
+    std::error_code ec;
+    fs::remove(path_for(file), ec);
+}
+
+void journal::add(int64_t first, int64_t last)
+{
+    if (first >= last)
+        return;
+
+    /* Insert the range in order, and merge it with any range it overlaps or touches. */
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), range{first, last});
+    it = ranges.insert(it, {first, last});
+
+    if (it != ranges.begin() && std::prev(it)->second >= it->first)
+        it = std::prev(it);
+
+    while (std::next(it) != ranges.end() && std::next(it)->first <= it->second) {
+        it->second = std::max(it->second, std::next(it)->second);
+        ranges.erase(std::next(it));
+    }
+}
+
+int64_t journal::bytes() const
+{
+    int64_t sum = 0;
+    for (const auto &[first, last] : ranges)
+        sum += last - first;
+
+    return sum;
+}
+
+int64_t journal::prefix() const
+{
+    return !ranges.empty() && ranges.front().first == 0 ? ranges.front().second : 0;
+}
+
+vector<journal::range> journal::missing() const
+{
+    vector<range> gaps;
+    int64_t at = 0;
+
+    for (const auto &[first, last] : ranges) {
+        if (first > at)
+            gaps.emplace_back(at, first);
+        at = std::max(at, last);
+    }
+
+    if (at < size)
+        gaps.emplace_back(at, size);
+
+    return gaps;
+}
+
+/* ns bookwyrm */
+}
@@ -15,25 +15,94 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 #include <termbox.h>
 
 #include "components/screen_butler.hpp"
 
 namespace butler {
 
-screen_butler::screen_butler(vector<bookwyrm::item> &items, logger_t logger)
-    : items_(items), logger_(logger), viewing_details_(false)
+/* Where SIGWINCH wakes display() up, and what termbox wanted done on it. */
+static int sigwinch_fd = -1;
+static struct sigaction termbox_sigwinch;
+
+/* Wake up whoever polls the other end of the given pipe. */
+static void wake(int fd)
+{
+    if (write(fd, "!", 1) < 0) {
+        /* The pipe is full, so a wakeup is pending anyway. */
+    }
+}
+
+static void on_sigwinch(int sig)
+{
+    /* Termbox notices resizes through its own handler; keep it in the loop. */
+    if (termbox_sigwinch.sa_handler != SIG_DFL && termbox_sigwinch.sa_handler != SIG_IGN)
+        termbox_sigwinch.sa_handler(sig);
+
+    const int saved_errno = errno;
+    wake(sigwinch_fd);
+    errno = saved_errno;
+}
+
+screen_butler::screen_butler(bookwyrm::item_store &items, bookwyrm::top_items *top, logger_t logger, int refresh_rate)
+    : items_(items), logger_(logger), frame_time_(std::chrono::microseconds(std::chrono::seconds(1)) / refresh_rate),
+    viewing_details_(false)
 {
     /* Create the log screen. */
     log_ = std::make_shared<screen::log>();
 
     /* And create the default menu screen and focus on it. */
-    index_ = std::make_shared<screen::multiselect_menu>(items_);
+    index_ = std::make_shared<screen::multiselect_menu>(items_, top);
     focused_ = index_;
+
+    if (pipe2(wake_pipe_, O_NONBLOCK | O_CLOEXEC) != 0)
+        throw component_error(fmt::format("unable to create a pipe: {}", std::strerror(errno)));
+
+    /* Termbox is initialized by now, and has installed its SIGWINCH handler; wrap it. */
+    sigwinch_fd = wake_pipe_[1];
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_sigwinch;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &sa, &termbox_sigwinch);
+}
+
+screen_butler::~screen_butler()
+{
+    sigaction(SIGWINCH, &termbox_sigwinch, nullptr);
+    sigwinch_fd = -1;
+
+    close(wake_pipe_[0]);
+    close(wake_pipe_[1]);
 }
 
 void screen_butler::repaint_screens()
 {
+    /* Only the first request since the last paint needs to wake display(). */
+    if (!dirty_.exchange(true))
+        wake(wake_pipe_[1]);
+}
+
+void screen_butler::paint_screens()
+{
+    {
+        std::lock_guard<std::mutex> guard(pending_mutex_);
+        for (const auto &[level, entry] : pending_logs_)
+            log_->log_entry(level, entry);
+
+        pending_logs_.clear();
+    }
+
+    /* Whether the menu is shown or not. */
+    index_->rank_new_items();
+
     tb_clear();
 
     if (!bookwyrm_fits()) {
@@ -89,40 +158,81 @@ void screen_butler::resize_screens()
 
 bool screen_butler::display()
 {
-    repaint_screens();
+    using clock = std::chrono::steady_clock;
+
+    dirty_ = true;
+    auto next_frame = clock::now();
+
+    std::array<pollfd, 2> fds = {{
+        {screen::base::terminal_fd(), POLLIN, 0},
+        {wake_pipe_[0], POLLIN, 0}
+    }};
+
+    for (;;) {
+        /* With something to paint, sleep no further than the next frame. */
+        int timeout = -1;
+        if (dirty_) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next_frame - clock::now());
+            timeout = std::max<int>(left.count(), 0);
+        }
 
-    struct keys::event ev;
-    while (keys::poll_event(ev)) {
-        if (ev.type == type::resize) {
-            close_details();
-            resize_screens();
-        } else if (ev.type == type::key_press) {
-            if (ev.key == key::escape)
-                return false;
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            throw program_error(fmt::format("unable to poll input: {}", std::strerror(errno)));
 
-            /* When the terminal is too small, only allow quitting and window resizing. */
-            if (!bookwyrm_fits())
-                continue;
+        if (fds[1].revents & POLLIN) {
+            char buf[64];
+            while (read(wake_pipe_[0], buf, sizeof(buf)) > 0);
+        }
 
-            if (ev.key == key::enter)
-                return true;
+        /*
+         * Handle every event termbox has for us. It may have read more than one at
+         * once, and only it knows whether the terminal was resized, so always ask.
+         */
+        struct keys::event ev;
+        int res;
+        while ((res = keys::peek_event(ev, 0)) > 0) {
+            if (auto done = handle_event(ev); done)
+                return *done;
+        }
 
-            if (meta_action(ev.key, ev.ch) || focused_->action(ev.key, ev.ch))
-                repaint_screens();
+        if (res < 0)
+            throw program_error("unable to poll input");
+
+        if (dirty_ && clock::now() >= next_frame) {
+            /* Whatever happens until the next frame is painted along with it. */
+            next_frame = clock::now() + frame_time_;
+            dirty_ = false;
+            paint_screens();
         }
     }
-
-    throw program_error("unable to poll input");
 }
 
-vector<bookwyrm::item> screen_butler::get_wanted_items()
+std::optional<bool> screen_butler::handle_event(const keys::event &ev)
 {
-    vector<bookwyrm::item> items;
+    if (ev.type == type::resize) {
+        close_details();
+        resize_screens();
+    } else if (ev.type == type::key_press) {
+        if (ev.key == key::escape)
+            return false;
+
+        /* When the terminal is too small, only allow quitting and window resizing. */
+        if (!bookwyrm_fits())
+            return std::nullopt;
 
-    for (int idx : index_->marked_items())
-        items.push_back(items_[idx]);
+        if (ev.key == key::enter)
+            return true;
+
+        if (meta_action(ev.key, ev.ch) || focused_->action(ev.key, ev.ch))
+            repaint_screens();
+    }
 
-    return items;
+    return std::nullopt;
+}
+
+size_t screen_butler::wanted_item_count()
+{
+    return index_->marked_items().size();
 }
 
 bool screen_butler::bookwyrm_fits()
@@ -199,6 +309,8 @@ bool screen_butler::toggle_log()
         focused_ = last_;
     }
 
+    log_focused_ = focused_ == log_;
+
     return true;
 }
 
@@ -224,9 +336,11 @@ void screen_butler::wprintcont(int x, const int y, const string_view &str, const
 
 namespace tui {
 
-std::shared_ptr<butler::screen_butler> make_with(butler::script_butler &script_butler, vector<py::module> &seekers, logger_t &logger)
+std::shared_ptr<butler::screen_butler> make_with(butler::script_butler &script_butler, vector<py::module> &seekers,
+        logger_t &logger, int refresh_rate)
 {
-    auto tui = std::make_shared<butler::screen_butler>(script_butler.results(), logger);
+    auto tui = std::make_shared<butler::screen_butler>(script_butler.results(), script_butler.top(),
+            logger, refresh_rate);
     script_butler.set_screen_butler(tui);
     logger->set_screen_butler(tui);
     script_butler.async_search(seekers); // Watch out, it's hot!
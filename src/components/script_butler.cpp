@@ -17,9 +17,18 @@
 
 #include <system_error>
 #include <cerrno>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <array>
+#include <chrono>
 #include <experimental/filesystem>
 
 #include "utils.hpp"
@@ -30,8 +39,39 @@ namespace fs = std::experimental::filesystem;
 
 namespace butler {
 
-script_butler::script_butler(const bookwyrm::item &&wanted, logger_t logger)
-    : logger_(logger), wanted_(wanted) {}
+/* How many fed items may wait for the consumer, and how many it handles before repainting. */
+static constexpr size_t queue_capacity = 4096,
+                        batch_size = 256;
+
+/*
+ * How long the worker reader waits for data before checking whether we are destructing,
+ * and how long a worker asked to terminate has to do so before it is killed.
+ */
+static constexpr int worker_poll_ms = 100,
+                     worker_grace_ms = 1000;
+
+/* How many bytes of found items a worker may have written ahead of us. */
+static constexpr size_t worker_ring_size = 1024 * 1024;
+
+/* Is the seeker's find a coroutine function, to be run on an event loop? */
+static bool is_async(const py::module &seeker)
+{
+    return py::hasattr(seeker, "find") &&
+        py::module::import("inspect").attr("iscoroutinefunction")(seeker.attr("find")).cast<bool>();
+}
+
+script_butler::script_butler(bookwyrm::item &&wanted, logger_t logger, backpressure when_full, size_t top,
+        seeker_mode mode)
+    : logger_(logger), wanted_(std::move(wanted)), query_(wanted_), plugin_query_(wanted_), dedup_(items_), mode_(mode),
+    queue_(queue_capacity), when_full_(when_full)
+{
+    if (top > 0)
+        top_ = std::make_unique<bookwyrm::top_items>(items_, top);
+
+    room_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (room_fd_ == -1)
+        throw program_error(string("can't create eventfd: ") + std::strerror(errno));
+}
 
 vector<pybind11::module> script_butler::load_seekers()
 {
@@ -39,6 +79,10 @@ vector<pybind11::module> script_butler::load_seekers()
 #ifdef DEBUG
     /* Bookwyrm must be run from build/ in DEBUG mode. */
     seeker_paths = { fs::canonical(fs::path("../src/seekers")) };
+
+    /* Native seekers built along with us are left in the build tree. */
+    if (fs::is_directory(BUILT_SEEKERS_DIR))
+        seeker_paths.emplace_back(BUILT_SEEKERS_DIR);
 #else
     /* TODO: look through /etc/bookwyrm/seekers/ also. */
     if (fs::path conf = std::getenv("XDG_CONFIG_HOME"); !conf.empty())
@@ -70,6 +114,19 @@ vector<pybind11::module> script_butler::load_seekers()
     vector<py::module> seekers;
     for (const auto &seeker_path : seeker_paths) {
         for (const fs::path &p : fs::directory_iterator(seeker_path)) {
+            /* Only by name: loading any other shared object here (e.g. pybookwyrm itself) runs its code. */
+            if (bookwyrm::plugin::is_plugin(p)) {
+                try {
+                    plugins_.emplace_back(p);
+                    logger_->debug("loaded native seeker '{}'", plugins_.back().name());
+                } catch (const program_error &err) {
+                    logger_->error("can't load native seeker '{}': {}; ignoring...",
+                            p.string(), err.what());
+                }
+
+                continue;
+            }
+
             if (p.extension() != ".py") continue;
 
             if (!utils::readable_file(p)) {
@@ -88,7 +145,7 @@ vector<pybind11::module> script_butler::load_seekers()
         }
     }
 
-    if (seekers.empty())
+    if (seekers.empty() && plugins_.empty())
         throw program_error("couldn't find any valid seeker scripts");
 
     return seekers;
@@ -107,12 +164,41 @@ script_butler::~script_butler()
 
     for (auto &t : threads_)
         t.join();
+
+    /* Nothing more will be fed; let the consumer finish what's queued. */
+    seekers_done_ = true;
+    consumer_wakeup_.notify_one();
+    if (consumer_.joinable())
+        consumer_.join();
+
+    if (const size_t dropped = dropped_; dropped > 0)
+        logger_->warn("{} items were found faster than they could be handled and were dropped", dropped);
+
+    ::close(room_fd_);
 }
 
 void script_butler::async_search(vector<py::module> &seekers)
 {
+    if (mode_ == seeker_mode::processes) {
+        /* Before any thread of ours runs, lest a child inherit a lock it holds. */
+        fork_workers(seekers);
+        consumer_ = std::thread([this]() { consume_items(); });
+        return;
+    }
+
+    consumer_ = std::thread([this]() { consume_items(); });
+
+    /* Coroutines share a thread; the rest get one each. */
+    vector<const py::module*> coroutines;
+
     for (const auto &m : seekers) {
-        threads_.emplace_back([&m, wanted = wanted_, bw_instance = this]() {
+        if (is_async(m)) {
+            coroutines.push_back(&m);
+            continue;
+        }
+
+        /* Handed to Python by reference; it outlives the threads. */
+        threads_.emplace_back([&m, wanted = &wanted_, bw_instance = this]() {
             /* Required whenever we need to run anything Python. */
             py::gil_scoped_acquire gil;
 
@@ -124,24 +210,548 @@ void script_butler::async_search(vector<py::module> &seekers)
             }
         });
     }
+
+    if (!coroutines.empty()) {
+        threads_.emplace_back([this, coroutines = std::move(coroutines)]() {
+            py::gil_scoped_acquire gil;
+            run_async(coroutines);
+        });
+    }
+
+    /* These don't need the GIL. */
+    for (const auto &p : plugins_)
+        threads_.emplace_back([this, &p]() { run_plugin(p); });
+}
+
+bool script_butler::run_async(const vector<const py::module*> &seekers)
+{
+    auto asyncio = py::module::import("asyncio");
+    auto loop = asyncio.attr("new_event_loop")();
+    asyncio.attr("set_event_loop")(loop);
+
+    bool ok = true;
+    const auto failed = [this, &ok](const py::module &m, const string &what) {
+        log_entry(spdlog::level::err, fmt::format("module '{}' did something wrong:\n{}\n; ignoring...",
+            m.attr("__name__").cast<string>(), what));
+        ok = false;
+    };
+
+    vector<std::pair<const py::module*, py::object>> tasks;
+    py::set pending;
+    for (const auto *m : seekers) {
+        try {
+            auto task = loop.attr("create_task")(m->attr("find")(&wanted_, this));
+            pending.add(task);
+            tasks.emplace_back(m, std::move(task));
+        } catch (const py::error_already_set &err) {
+            failed(*m, err.what());
+        }
+    }
+
+    /* Come up for air every so often, to see whether we should stop. */
+    bool cancelled = false;
+    try {
+        while (py::len(pending) > 0) {
+            if (destructing_ && !cancelled) {
+                for (auto task : pending)
+                    task.attr("cancel")();
+                cancelled = true;
+            }
+
+            const auto done_pending = loop.attr("run_until_complete")(
+                asyncio.attr("wait")(pending, "timeout"_a = worker_poll_ms / 1000.0));
+            pending = done_pending.cast<py::tuple>()[1].cast<py::set>();
+        }
+    } catch (const py::error_already_set &err) {
+        /* Something a task raised that the loop doesn't catch, such as SystemExit. */
+        log_entry(spdlog::level::err, fmt::format("the event loop of the async seekers did something wrong:"
+            "\n{}\n; ignoring...", err.what()));
+        return false;
+    }
+
+    auto format_exception = py::module::import("traceback").attr("format_exception");
+    for (const auto &[m, task] : tasks) {
+        if (task.attr("cancelled")().cast<bool>())
+            continue;
+
+        if (const auto exc = task.attr("exception")(); !exc.is_none()) {
+            const auto lines = format_exception(exc.attr("__class__"), exc, exc.attr("__traceback__"));
+            failed(*m, py::str("").attr("join")(lines).cast<string>());
+        }
+    }
+
+    loop.attr("run_until_complete")(loop.attr("shutdown_asyncgens")());
+    loop.attr("close")();
+    return ok;
+}
+
+void script_butler::add_item(item_comps_t item_comps)
+{
+    if (ring_) {
+        string record;
+        wire::put_item(record, std::get<0>(item_comps), std::get<1>(item_comps), std::get<2>(item_comps));
+        send(record);
+        return;
+    }
+
+    if (push(std::move(item_comps)))
+        wake_consumer();
+}
+
+void script_butler::add_items(vector<item_comps_t> items)
+{
+    if (ring_) {
+        string record;
+        for (const auto &[nonexacts, exacts, misc] : items) {
+            record.clear();
+            wire::put_item(record, nonexacts, exacts, misc);
+            send(record);
+        }
+
+        return;
+    }
+
+    bool any = false;
+    for (auto &item_comps : items) {
+        if (destructing_) break;
+        any |= push(std::move(item_comps));
+    }
+
+    if (any) wake_consumer();
 }
 
-void script_butler::add_item(std::tuple<bookwyrm::nonexacts_t, bookwyrm::exacts_t, bookwyrm::misc_t> item_comps)
+bool script_butler::try_add_items(item_batch &batch)
 {
-    bookwyrm::item item(item_comps);
-    if (!item.matches(wanted_))
+    bool any = false, full = false;
+
+    for (; batch.next < batch.items.size(); batch.next++) {
+        /* Whatever is left won't be wanted anyway. */
+        if (destructing_) {
+            batch.next = batch.items.size();
+            break;
+        }
+
+        auto &item_comps = batch.items[batch.next];
+
+        if (ring_) {
+            string record;
+            wire::put_item(record, std::get<0>(item_comps), std::get<1>(item_comps), std::get<2>(item_comps));
+
+            /* Too big a record is dropped, as by send. */
+            if (record.size() <= ring_->max_record() && !ring_->write_or_prepare_wait(record)) {
+                if (ring_->closed())
+                    destructing_ = true;
+                full = !destructing_;
+                break;
+            }
+
+            continue;
+        }
+
+        if (queue_.try_push(std::move(item_comps))) {
+            any = true;
+            continue;
+        }
+
+        if (when_full_ == backpressure::drop) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        /*
+         * Say we want room before the last look, so that the consumer can't make
+         * some unnoticed: it looks for us after it has (see consume_items).
+         */
+        room_wanted_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue_.try_push(std::move(item_comps))) {
+            any = true;
+            continue;
+        }
+
+        /* Full: the consumer had better get going. */
+        any = full = true;
+        break;
+    }
+
+    if (any) wake_consumer();
+    return !full;
+}
+
+void script_butler::room_made()
+{
+    if (ring_) {
+        ring_->done_waiting_to_write();
         return;
+    }
+
+    uint64_t count;
+    while (::read(room_fd_, &count, sizeof(count)) == -1 && errno == EINTR);
+}
+
+bool script_butler::push(item_comps_t &&item_comps)
+{
+    if (queue_.try_push(std::move(item_comps)))
+        return true;
+
+    if (when_full_ == backpressure::drop) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /* Wait for the consumer to make room; it may be waiting for us to wake it. */
+    wake_consumer();
 
-    std::lock_guard<std::mutex> guard(items_mutex_);
+    while (!queue_.try_push(std::move(item_comps))) {
+        if (destructing_) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
 
-    items_.push_back(item);
-    screen_butler_->repaint_screens();
+    return true;
+}
+
+void script_butler::wake_consumer()
+{
+    /*
+     * Only bother the consumer if it's waiting. Should it just have decided to, it
+     * will find the items when its wait times out instead.
+     */
+    if (consumer_idle_.load(std::memory_order_relaxed))
+        consumer_wakeup_.notify_one();
+}
+
+void script_butler::consume_items()
+{
+    for (;;) {
+        /* Read before draining: whatever was fed before the seekers were done is in the queue by now. */
+        const bool last_round = seekers_done_;
+        bool changed = false;
+
+        const size_t count = queue_.consume([this, &changed](item_comps_t &&comps) {
+            bookwyrm::item candidate(std::move(comps));
+
+            /* Most candidates are turned away here, before they cost us a duplicate lookup. */
+            const auto score = query_.score(candidate);
+            if (!score) return;
+
+            /* Found by another seeker already? Then it's just somewhere else to get it from. */
+            if (const auto original = dedup_.find(candidate); original) {
+                changed |= items_[*original].add_mirrors(candidate);
+                return;
+            }
+
+            candidate.set_score(*score);
+            candidate.keep(strings_);
+
+            std::optional<size_t> idx;
+            if (top_) {
+                idx = top_->offer(std::move(candidate));
+            } else {
+                idx = items_.size();
+                items_.push_back(std::move(candidate));
+            }
+
+            if (idx) {
+                dedup_.add(*idx);
+                changed = true;
+            }
+        }, batch_size);
+
+        if (changed)
+            screen_butler_->repaint_screens();
+
+        if (count > 0) {
+            /* Wake the seekers on the event loop waiting for room, if any. */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (room_wanted_.load(std::memory_order_relaxed) && room_wanted_.exchange(false)) {
+                const uint64_t one = 1;
+                while (::write(room_fd_, &one, sizeof(one)) == -1 && errno == EINTR);
+            }
+
+            continue;
+        }
+        if (last_round)
+            return;
+
+        std::unique_lock<std::mutex> lock(consumer_mutex_);
+        consumer_idle_ = true;
+        consumer_wakeup_.wait_for(lock, std::chrono::milliseconds(20));
+        consumer_idle_ = false;
+    }
 }
 
 void script_butler::log_entry(spdlog::level::level_enum lvl, string msg)
 {
+    if (ring_) {
+        string record;
+        wire::put_log(record, lvl, msg);
+        send(record);
+        return;
+    }
+
     logger_->log(lvl, msg);
 }
 
+void script_butler::fork_workers(vector<py::module> &seekers)
+{
+    vector<worker> workers;
+
+    for (const auto &m : seekers) {
+        const auto name = m.attr("__name__").cast<string>();
+
+        fork_worker(workers, name, [this, &m, &name]() {
+            if (is_async(m))
+                return run_async({&m});
+
+            try {
+                m.attr("find")(&wanted_, this);
+                return true;
+            } catch (const py::error_already_set &err) {
+                log_entry(spdlog::level::err, fmt::format("module '{}' did something wrong:\n{}\n; ignoring...",
+                    name, err.what()));
+                return false;
+            }
+        });
+    }
+
+    for (const auto &p : plugins_) {
+        fork_worker(workers, p.name(), [this, &p]() {
+            run_plugin(p);
+            return true;
+        });
+    }
+
+    threads_.emplace_back([this, workers = std::move(workers)]() mutable {
+        read_workers(workers);
+    });
+}
+
+void script_butler::fork_worker(vector<worker> &workers, const string &name, const std::function<bool()> &find)
+{
+    std::unique_ptr<bookwyrm::shm_ring> ring;
+    try {
+        ring = std::make_unique<bookwyrm::shm_ring>(worker_ring_size);
+    } catch (const program_error &err) {
+        logger_->error("can't start module '{}': {}; ignoring...", name, err.what());
+        return;
+    }
+
+    /* Not written to: we learn that the child is gone when it's closed. */
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        logger_->error("can't start module '{}': {}; ignoring...", name, std::strerror(errno));
+        return;
+    }
+
+    /* We hold the GIL, so the child gets the interpreter in a consistent state. */
+#if PY_VERSION_HEX >= 0x03070000
+    PyOS_BeforeFork();
+#endif
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+#if PY_VERSION_HEX >= 0x03070000
+        PyOS_AfterFork_Child();
+#else
+        PyOS_AfterFork();
+#endif
+        /* The other workers are none of our business. */
+        for (const auto &w : workers)
+            close(w.fd);
+        close(fds[0]);
+
+        ring_ = ring.get();
+        const bool found = find();
+
+        /* Everything else, including the terminal, is the parent's to clean up. */
+        std::_Exit(found ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+#if PY_VERSION_HEX >= 0x03070000
+    PyOS_AfterFork_Parent();
+#endif
+    close(fds[1]);
+
+    if (pid == -1) {
+        logger_->error("can't start module '{}': {}; ignoring...", name, std::strerror(errno));
+        close(fds[0]);
+        return;
+    }
+
+    workers.push_back({pid, fds[0], name, std::move(ring)});
+}
+
+void script_butler::run_plugin(const bookwyrm::plugin &plugin)
+{
+    const bookwyrm_sink sink = {this, plugin_feed, plugin_log, plugin_terminating};
+    plugin.find(plugin_query_.get(), sink);
+}
+
+void script_butler::plugin_feed(void *context, const bookwyrm_item *items, size_t count)
+{
+    auto *butler = static_cast<script_butler*>(context);
+
+    if (butler->ring_) {
+        /* Straight from what we were fed into the record; the parent copies what it queues. */
+        string record;
+        for (size_t i = 0; i < count && !butler->destructing_; i++) {
+            const auto item = bookwyrm::plugin::to_item(items[i]);
+            record.clear();
+            wire::put_item(record, item.nonexacts(), item.exacts(), item.misc());
+            butler->send(record);
+        }
+
+        return;
+    }
+
+    bool any = false;
+    for (size_t i = 0; i < count && !butler->destructing_; i++) {
+        auto item = bookwyrm::plugin::to_item(items[i]);
+        item.own();
+        any |= butler->push(std::move(item).release());
+    }
+
+    if (any) butler->wake_consumer();
+}
+
+void script_butler::plugin_log(void *context, int level, bookwyrm_str msg)
+{
+    if (level < spdlog::level::trace || level > spdlog::level::critical)
+        level = spdlog::level::warn;
+
+    static_cast<script_butler*>(context)->log_entry(static_cast<spdlog::level::level_enum>(level),
+            msg.size == 0 ? string() : string(msg.data, msg.size));
+}
+
+int script_butler::plugin_terminating(void *context)
+{
+    return static_cast<script_butler*>(context)->is_destructing();
+}
+
+void script_butler::send(const string &record)
+{
+    if (record.size() > ring_->max_record())
+        return;
+
+    while (!destructing_ && !ring_->write(record, worker_poll_ms)) {
+        if (ring_->closed())
+            destructing_ = true;
+    }
+}
+
+bool script_butler::drain(worker &w, const bookwyrm::compiled_query &query)
+{
+    bool fed = false;
+
+    while (const auto record = w.ring->peek()) {
+        if (wire::kind_of(*record) == wire::kind::item) {
+            /* Only bother copying and queueing what has a chance of being wanted. */
+            auto candidate = wire::get_item(*record);
+            if (query.matches(candidate)) {
+                candidate.own();
+                fed |= push(std::move(candidate).release());
+            }
+        } else {
+            const auto [lvl, msg] = wire::get_log(*record);
+            logger_->log(lvl, msg);
+        }
+
+        w.ring->release();
+    }
+
+    return fed;
+}
+
+void script_butler::read_workers(vector<worker> &workers)
+{
+    /* Our own, as the consumer's may only be used by the consumer. */
+    const bookwyrm::compiled_query query(wanted_);
+    vector<pollfd> fds;
+
+    for (;;) {
+        if (destructing_) {
+            for (auto &w : workers) {
+                if (w.fd != -1)
+                    reap(w, true);
+            }
+
+            return;
+        }
+
+        bool fed = false, more = false;
+        fds.clear();
+
+        for (auto &w : workers) {
+            if (w.fd == -1) continue;
+
+            try {
+                fed |= drain(w, query);
+            } catch (const value_error &err) {
+                logger_->error("module '{}' sent garbage ({}); stopping it...", w.name, err.what());
+                reap(w, true);
+                continue;
+            }
+
+            more |= w.ring->prepare_wait();
+            fds.push_back({w.fd, POLLIN, 0});
+            fds.push_back({w.ring->readable_fd(), POLLIN, 0});
+        }
+
+        if (fed) wake_consumer();
+        if (fds.empty())
+            return;
+
+        if (!more)
+            poll(fds.data(), fds.size(), worker_poll_ms);
+
+        for (auto &w : workers) {
+            if (w.fd == -1) continue;
+            w.ring->done_waiting();
+
+            const auto gone = std::find_if(fds.cbegin(), fds.cend(), [&w](const pollfd &p) {
+                return p.fd == w.fd && p.revents != 0;
+            });
+            if (gone == fds.cend()) continue;
+
+            /* It has exited; whatever it wrote before that is still to be read. */
+            try {
+                if (drain(w, query))
+                    wake_consumer();
+            } catch (const value_error &err) {
+                logger_->error("module '{}' sent garbage ({})", w.name, err.what());
+            }
+
+            reap(w, false);
+        }
+    }
+}
+
+void script_butler::reap(worker &w, bool kill)
+{
+    close(w.fd);
+    w.fd = -1;
+
+    int status = 0;
+    if (kill) {
+        w.ring->close();
+        ::kill(w.pid, SIGTERM);
+
+        /* Give it a moment to go quietly. */
+        for (int waited = 0; waitpid(w.pid, &status, WNOHANG) == 0; waited += 10) {
+            if (waited >= worker_grace_ms) {
+                ::kill(w.pid, SIGKILL);
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    while (waitpid(w.pid, &status, 0) == -1 && errno == EINTR);
+
+    if (WIFSIGNALED(status) && !kill)
+        logger_->error("module '{}' crashed ({}); ignoring...", w.name, strsignal(WTERMSIG(status)));
+}
+
 /* ns butler */
 }
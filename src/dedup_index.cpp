@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+
+#include "dedup_index.hpp"
+#include "fuzzy.hpp"
+
+namespace bookwyrm {
+
+/*
+ * An ISBN with only its digits (and check character) left, as an ISBN-13, so
+ * that both forms of the same one compare equal. Empty if it isn't one.
+ */
+static string normalize_isbn(const string_view &isbn)
+{
+    string digits;
+    for (const char c : isbn) {
+        if (std::isdigit(static_cast<unsigned char>(c)))
+            digits.push_back(c);
+        else if (c == 'x' || c == 'X')
+            digits.push_back('X');
+    }
+
+    if (digits.length() == 13)
+        return digits;
+    if (digits.length() != 10)
+        return {};
+
+    /* Prefix it, and recompute the check digit. */
+    digits = "978" + digits.substr(0, 9);
+
+    int sum = 0;
+    for (size_t i = 0; i < digits.length(); i++)
+        sum += (digits[i] - '0') * (i % 2 == 0 ? 1 : 3);
+
+    digits.push_back('0' + (10 - sum % 10) % 10);
+    return digits;
+}
+
+/* Normalize the string, with runs of spaces squeezed into one. */
+static void append_normalized(string &out, const string_view &str, string &buffer)
+{
+    const auto normalized = fuzzy::normalize(str, buffer);
+    for (size_t i = 0; i < normalized.size(); i++) {
+        if (normalized[i] != ' ' || normalized[i - 1] != ' ')
+            out.push_back(normalized[i]);
+    }
+}
+
+/* What an item is known by, apart from its ISBNs; empty if it has no title. */
+static void details_key(const item &i, string &key, string &buffer, vector<string> &authors)
+{
+    key.clear();
+    if (i.nonexacts().title().empty())
+        return;
+
+    append_normalized(key, i.nonexacts().title(), buffer);
+
+    /* Authors are listed in whatever order the source had them. */
+    authors.clear();
+    for (const auto &author : i.nonexacts().authors()) {
+        authors.emplace_back();
+        append_normalized(authors.back(), author, buffer);
+    }
+
+    std::sort(authors.begin(), authors.end());
+    for (const auto &author : authors)
+        key.append(1, '\x1f').append(author);
+
+    key.append(1, '\x1f').append(std::to_string(i.exacts().year()));
+    key.append(1, '\x1f').append(i.exacts().extension().data(), i.exacts().extension().size());
+}
+
+static bool has_isbn(const item &i, const string &isbn)
+{
+    return std::any_of(i.misc().isbns().cbegin(), i.misc().isbns().cend(), [&isbn](const string_view &other) {
+        return normalize_isbn(other) == isbn;
+    });
+}
+
+std::optional<size_t> dedup_index::find(const item &candidate)
+{
+    for (const auto &isbn : candidate.misc().isbns()) {
+        const auto normalized = normalize_isbn(isbn);
+        if (normalized.empty()) continue;
+
+        const auto found = by_isbn_.find(normalized + '\x1f' + string(candidate.exacts().extension()));
+        if (found == by_isbn_.cend()) continue;
+
+        const auto &stored = store_[found->second];
+        if (stored.exacts().extension() == candidate.exacts().extension() && has_isbn(stored, normalized))
+            return found->second;
+    }
+
+    details_key(candidate, key_, buffer_, authors_);
+    if (key_.empty())
+        return std::nullopt;
+
+    const auto found = by_details_.find(std::hash<string>{}(key_));
+    if (found == by_details_.cend())
+        return std::nullopt;
+
+    /* Hashes may collide, and slots may have been filled with something else since. */
+    details_key(store_[found->second], other_key_, buffer_, authors_);
+    if (other_key_ != key_)
+        return std::nullopt;
+
+    return found->second;
+}
+
+void dedup_index::add(size_t idx)
+{
+    const auto &stored = store_[idx];
+
+    for (const auto &isbn : stored.misc().isbns()) {
+        if (const auto normalized = normalize_isbn(isbn); !normalized.empty())
+            by_isbn_[normalized + '\x1f' + string(stored.exacts().extension())] = idx;
+    }
+
+    details_key(stored, key_, buffer_, authors_);
+    if (!key_.empty())
+        by_details_[std::hash<string>{}(key_)] = idx;
+}
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,641 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "fuzzy.hpp"
+
+namespace fuzzy {
+
+/*
+ * A ratio as a percentage, rounded as fuzzywuzzy does: to the closest integer,
+ * ties to even (Python's round()).
+ */
+static int percent(double ratio)
+{
+    return static_cast<int>(std::nearbyint(100 * ratio));
+}
+
+/* difflib's ratio of two strings of the given total length with so many characters matched up. */
+static double difflib_ratio(int matched, size_t total_length)
+{
+    return total_length == 0 ? 1.0 : 2.0 * matched / total_length;
+}
+
+/* fuzzywuzzy's partial_ratio gives up looking for better once a window scores this. */
+static constexpr double partial_perfect = .995;
+
+pattern::pattern(string_view str)
+{
+    assign(str);
+}
+
+void pattern::assign(string_view str)
+{
+    str_.assign(str.data(), str.size());
+    words_ = (str.size() + word_bits - 1) / word_bits;
+
+    masks_.assign((std::numeric_limits<unsigned char>::max() + 1) * words_, 0);
+    for (size_t i = 0; i < str.size(); i++) {
+        const auto c = static_cast<unsigned char>(str[i]);
+        masks_[c * words_ + i / word_bits] |= mask_t(1) << (i % word_bits);
+    }
+
+    state_.resize(words_);
+}
+
+int pattern::lcs(string_view text) const
+{
+    /*
+     * A zero in the state marks a position in the pattern where the common
+     * subsequence grew. For each character of the text, the state is updated by
+     * one addition (which moves each such zero onto the next match of the
+     * character, if any) and one subtraction (which adds a zero where a match
+     * comes before any other).
+     */
+    const size_t tail = str_.size() % word_bits;
+    const mask_t tail_mask = tail == 0 ? ~mask_t(0) : (mask_t(1) << tail) - 1;
+
+    if (words_ == 1) {
+        mask_t state = ~mask_t(0);
+        for (const char c : text) {
+            const mask_t matches = state & *masks(c);
+            state = (state + matches) | (state - matches);
+        }
+
+        return __builtin_popcountll(~state & tail_mask);
+    }
+
+    std::fill(state_.begin(), state_.end(), ~mask_t(0));
+    for (const char c : text) {
+        const mask_t *m = masks(c);
+
+        /* One long addition, carrying from word to word. */
+        mask_t carry = 0;
+        for (size_t w = 0; w < words_; w++) {
+            const mask_t state = state_[w],
+                         matches = state & m[w];
+
+            mask_t sum = state + matches;
+            const mask_t carried = sum < state;
+            sum += carry;
+            carry = carried | (sum < carry);
+
+            state_[w] = sum | (state - matches);
+        }
+    }
+
+    int length = 0;
+    for (size_t w = 0; w < words_; w++)
+        length += __builtin_popcountll(~state_[w] & (w + 1 == words_ ? tail_mask : ~mask_t(0)));
+
+    return length;
+}
+
+/*
+ * The least LCS of the shorter string, of the given length, and the longer, that
+ * could make a partial_ratio of at least cutoff; length + 1 if none could.
+ *
+ * A window of the longer string that matches up common characters with the
+ * shorter is at least that many characters long, but may be shorter than it
+ * when cut off by the end of the longer: the ratio is at most 2 common / (length + common).
+ */
+static int least_lcs(size_t length, int cutoff)
+{
+    int needed = 0;
+    for (; needed <= static_cast<int>(length); needed++) {
+        const double best = difflib_ratio(needed, length + needed);
+        if (best > partial_perfect || percent(best) >= cutoff)
+            break;
+    }
+
+    return needed;
+}
+
+/*
+ * Which profile bucket a byte is counted in: the same as for whatever it is
+ * normalized into, so that unnormalized text can be profiled.
+ */
+static constexpr auto buckets = [] {
+    std::array<unsigned char, 256> table = {};
+    for (int c = 0; c < 256; c++) {
+        if (c >= 'a' && c <= 'z')
+            table[c] = c - 'a';
+        else if (c >= 'A' && c <= 'Z')
+            table[c] = c - 'A';
+        else if (c >= '0' && c <= '9')
+            table[c] = 26 + c - '0';
+        else if (c >= 0x80)
+            table[c] = 37 + c % 27;
+        else
+            table[c] = 36;  /* a space */
+    }
+
+    return table;
+}();
+
+profile::profile(string_view str)
+    : length_(str.size())
+{
+    for (const char c : str)
+        counts_[buckets[static_cast<unsigned char>(c)]]++;
+}
+
+bool profile::may_reach(string_view text, int cutoff) const
+{
+    /* Equal strings score 100, even when empty; or else empty ones score 0. */
+    const size_t length = std::min(length_, text.size());
+    if (length == 0)
+        return cutoff <= 0 || text.size() == length_;
+
+    std::array<std::uint32_t, 64> counts = {};
+    for (const char c : text)
+        counts[buckets[static_cast<unsigned char>(c)]]++;
+
+    /* Each bucket can pair up as many characters as the emptier side has. */
+    std::uint32_t overlap = 0;
+    for (size_t b = 0; b < counts.size(); b++)
+        overlap += std::min(counts[b], counts_[b]);
+
+    return std::min<size_t>(overlap, length) >= static_cast<size_t>(least_lcs(length, cutoff));
+}
+
+string_view normalize(string_view str, string &out)
+{
+    out.clear();
+    for (const char c : str) {
+        const auto u = static_cast<unsigned char>(c);
+
+        if (u >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z'))
+            out.push_back(c);
+        else if (c >= 'A' && c <= 'Z')
+            out.push_back(c - 'A' + 'a');
+        else
+            out.push_back(' ');
+    }
+
+    const auto first = out.find_first_not_of(' ');
+    if (first == string::npos) {
+        out.clear();
+        return {};
+    }
+
+    out.erase(out.find_last_not_of(' ') + 1);
+    return string_view(out).substr(first);
+}
+
+string_view full_process(string_view str, string &out)
+{
+    out.clear();
+    for (const char c : str) {
+        if (static_cast<unsigned char>(c) >= 0x80)
+            continue;
+
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '_')
+            out.push_back(c);
+        else if (c >= 'A' && c <= 'Z')
+            out.push_back(c - 'A' + 'a');
+        else
+            out.push_back(' ');
+    }
+
+    const auto first = out.find_first_not_of(' ');
+    if (first == string::npos) {
+        out.clear();
+        return {};
+    }
+
+    out.erase(out.find_last_not_of(' ') + 1);
+    return string_view(out).substr(first);
+}
+
+void tokenize(string_view str, vector<string_view> &out)
+{
+    out.clear();
+
+    size_t pos = 0;
+    while ((pos = str.find_first_not_of(' ', pos)) != string_view::npos) {
+        const size_t end = std::min(str.find(' ', pos), str.size());
+        out.push_back(str.substr(pos, end - pos));
+        pos = end;
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+/*
+ * Index b as difflib does before matching anything against it: where each byte
+ * is, leaving out bytes that are too popular to be worth it in longer strings.
+ */
+static void index_b(string_view b, scratch &s)
+{
+    s.counts.fill(0);
+    for (const char c : b)
+        s.counts[static_cast<unsigned char>(c)]++;
+
+    /* difflib's autojunk. */
+    if (b.size() >= 200) {
+        const int popular = static_cast<int>(b.size() / 100 + 1);
+        for (auto &count : s.counts) {
+            if (count > popular)
+                count = 0;
+        }
+    }
+
+    s.b2j_start[0] = 0;
+    for (size_t c = 0; c < s.counts.size(); c++)
+        s.b2j_start[c + 1] = s.b2j_start[c] + s.counts[c];
+
+    s.b2j.resize(s.b2j_start.back());
+    for (size_t c = 0; c < s.counts.size(); c++)
+        s.counts[c] = s.b2j_start[c];
+
+    for (size_t j = 0; j < b.size(); j++) {
+        const auto c = static_cast<unsigned char>(b[j]);
+        if (s.counts[c] < s.b2j_start[c + 1])
+            s.b2j[s.counts[c]++] = static_cast<int>(j);
+    }
+
+    /* Indexed by position + 1, and zeroed again after use. */
+    s.j2len.assign(b.size() + 1, 0);
+    s.new_j2len.assign(b.size() + 1, 0);
+}
+
+/*
+ * The longest matching block of a[alo, ahi) and b[blo, bhi), as difflib's
+ * find_longest_match finds it: the earliest in a of the longest, and of those,
+ * the earliest in b, before extending it over popular bytes.
+ */
+static block longest_match(string_view a, string_view b, int alo, int ahi, int blo, int bhi, scratch &s)
+{
+    block best = {alo, blo, 0};
+
+    for (int i = alo; i < ahi; i++) {
+        const auto c = static_cast<unsigned char>(a[i]);
+
+        for (int idx = s.b2j_start[c]; idx < s.b2j_start[c + 1]; idx++) {
+            const int j = s.b2j[idx];
+            if (j < blo) continue;
+            if (j >= bhi) break;
+
+            const int k = s.new_j2len[j + 1] = s.j2len[j] + 1;
+            s.new_touched.push_back(j + 1);
+
+            if (k > best.k)
+                best = {i - k + 1, j - k + 1, k};
+        }
+
+        for (const int t : s.touched)
+            s.j2len[t] = 0;
+
+        std::swap(s.j2len, s.new_j2len);
+        std::swap(s.touched, s.new_touched);
+        s.new_touched.clear();
+    }
+
+    for (const int t : s.touched)
+        s.j2len[t] = 0;
+    s.touched.clear();
+
+    while (best.i > alo && best.j > blo && a[best.i - 1] == b[best.j - 1]) {
+        best.i--;
+        best.j--;
+        best.k++;
+    }
+
+    while (best.i + best.k < ahi && best.j + best.k < bhi && a[best.i + best.k] == b[best.j + best.k])
+        best.k++;
+
+    return best;
+}
+
+/*
+ * difflib's get_matching_blocks: the longest match, then recursively those to either
+ * side of it, in order, with adjacent blocks joined and an empty one at the end.
+ */
+static void matching_blocks(string_view a, string_view b, scratch &s)
+{
+    index_b(b, s);
+
+    s.blocks.clear();
+    s.queue.assign(1, {0, static_cast<int>(a.size()), 0, static_cast<int>(b.size())});
+
+    while (!s.queue.empty()) {
+        const auto [alo, ahi, blo, bhi] = s.queue.back();
+        s.queue.pop_back();
+
+        const block m = longest_match(a, b, alo, ahi, blo, bhi, s);
+        if (m.k == 0) continue;
+
+        s.blocks.push_back(m);
+        if (alo < m.i && blo < m.j)
+            s.queue.push_back({alo, m.i, blo, m.j});
+        if (m.i + m.k < ahi && m.j + m.k < bhi)
+            s.queue.push_back({m.i + m.k, ahi, m.j + m.k, bhi});
+    }
+
+    std::sort(s.blocks.begin(), s.blocks.end(), [](const block &x, const block &y) {
+        return x.i < y.i;
+    });
+
+    size_t joined = 0;
+    for (size_t n = 0; n < s.blocks.size(); n++) {
+        const block m = s.blocks[n];
+
+        if (joined > 0) {
+            block &last = s.blocks[joined - 1];
+            if (last.i + last.k == m.i && last.j + last.k == m.j) {
+                last.k += m.k;
+                continue;
+            }
+        }
+
+        s.blocks[joined++] = m;
+    }
+
+    s.blocks.resize(joined);
+    s.blocks.push_back({static_cast<int>(a.size()), static_cast<int>(b.size()), 0});
+}
+
+/* difflib's SequenceMatcher(None, a, b).ratio(). */
+static double sequence_ratio(string_view a, string_view b, scratch &s)
+{
+    matching_blocks(a, b, s);
+
+    int matched = 0;
+    for (const block &m : s.blocks)
+        matched += m.k;
+
+    return difflib_ratio(matched, a.size() + b.size());
+}
+
+int ratio(string_view a, string_view b, scratch &s)
+{
+    if (a == b)
+        return 100;
+    if (a.empty() || b.empty())
+        return 0;
+
+    return percent(sequence_ratio(a, b, s));
+}
+
+/*
+ * The LCS of a pattern of at most one lane's bits with as many consecutive windows
+ * of the text as there are lanes, the first starting at text[0]: the single-word
+ * step of pattern::lcs(), done for all windows at once.
+ */
+template <typename Lane, size_t Lanes>
+static inline void lcs_lanes(const pattern &needle, const char *text, int *lcs)
+{
+    typedef Lane vec __attribute__((vector_size(sizeof(Lane) * Lanes)));
+
+    const size_t length = needle.str().size();
+    vec state = ~vec{};
+
+    for (size_t t = 0; t < length; t++) {
+        vec matches = {};
+        for (size_t i = 0; i < Lanes; i++)
+            matches[i] = static_cast<Lane>(*needle.masks(text[i + t]));
+
+        matches &= state;
+        state = (state + matches) | (state - matches);
+    }
+
+    const Lane mask = length == sizeof(Lane) * 8 ? Lane(~Lane(0)) : Lane((Lane(1) << length) - 1);
+    for (size_t i = 0; i < Lanes; i++)
+        lcs[i] = __builtin_popcountll(Lane(~state[i] & mask));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The same, but with twice as many lanes. */
+template <typename Lane, size_t Lanes>
+__attribute__((target("avx2"), flatten))
+static void lcs_lanes_avx2(const pattern &needle, const char *text, int *lcs)
+{
+    lcs_lanes<Lane, Lanes>(needle, text, lcs);
+}
+#endif
+
+/* How to find the LCS of a pattern with many windows at once: lanes of them per run. */
+struct window_kernel {
+    size_t lanes;
+    void (*run)(const pattern &needle, const char *text, int *lcs);
+};
+
+/* The widest kernel this CPU has for a pattern of the given length. */
+static window_kernel pick_kernel(size_t length)
+{
+    /* Narrower lanes for shorter patterns: more windows per run. */
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    if (avx2) {
+        if (length <= 16) return {16, lcs_lanes_avx2<std::uint16_t, 16>};
+        if (length <= 32) return {8, lcs_lanes_avx2<std::uint32_t, 8>};
+        if (length <= 64) return {4, lcs_lanes_avx2<std::uint64_t, 4>};
+    }
+#endif
+
+    /* Sixteen-byte vectors are everywhere we care about (SSE2, NEON), or emulated. */
+    if (length <= 16) return {8, lcs_lanes<std::uint16_t, 8>};
+    if (length <= 32) return {4, lcs_lanes<std::uint32_t, 4>};
+    if (length <= 64) return {2, lcs_lanes<std::uint64_t, 2>};
+
+    /* Longer patterns span several words: one window at a time. */
+    return {1, nullptr};
+}
+
+/*
+ * Could the partial_ratio of the needle and the haystack reach the cutoff? Not unless
+ * some equally long substring of the haystack has enough in common with the needle,
+ * as every substring partial_ratio compares the needle with is within one of those.
+ */
+static bool window_may_reach(const pattern &needle, string_view haystack, scratch &s, int cutoff)
+{
+    const size_t length = needle.str().size(),
+                 windows = haystack.size() - length + 1;
+
+    const int needed = least_lcs(length, cutoff);
+    if (needed > static_cast<int>(length))
+        return false;
+
+    /*
+     * A window can't have more characters in common with the needle than their
+     * histograms do. Keep track of that, as the window slides: counts holds how
+     * many of each character the needle has that the window doesn't.
+     */
+    s.counts.fill(0);
+    for (const char c : needle.str())
+        s.counts[static_cast<unsigned char>(c)]++;
+
+    int overlap = 0;
+    const auto enter = [&s, &overlap](char c) {
+        if (s.counts[static_cast<unsigned char>(c)]-- > 0) overlap++;
+    };
+    const auto leave = [&s, &overlap](char c) {
+        if (++s.counts[static_cast<unsigned char>(c)] > 0) overlap--;
+    };
+
+    for (size_t i = 0; i + 1 < length; i++)
+        enter(haystack[i]);
+
+    const window_kernel kernel = pick_kernel(length);
+    std::array<int, 16> lcs;
+
+    for (size_t pos = 0; pos < windows; ) {
+        const size_t lanes = windows - pos >= kernel.lanes ? kernel.lanes : 1;
+
+        /* Only bother with windows that could make the cutoff. */
+        bool promising = false;
+        for (size_t i = 0; i < lanes; i++) {
+            enter(haystack[pos + i + length - 1]);
+            promising |= overlap >= needed;
+            leave(haystack[pos + i]);
+        }
+
+        if (promising) {
+            if (lanes == 1)
+                lcs[0] = needle.lcs(haystack.substr(pos, length));
+            else
+                kernel.run(needle, haystack.data() + pos, lcs.data());
+
+            if (*std::max_element(lcs.cbegin(), lcs.cbegin() + lanes) >= needed)
+                return true;
+        }
+
+        pos += lanes;
+    }
+
+    return false;
+}
+
+/* fuzzywuzzy's partial_ratio, once it's known which string is the shorter. */
+static int exact_partial_ratio(string_view shorter, string_view longer, scratch &s)
+{
+    /* The ratios below need the blocks' buffer. */
+    matching_blocks(shorter, longer, s);
+    s.windows.swap(s.blocks);
+
+    double best = 0;
+    for (const block &m : s.windows) {
+        const size_t start = std::max(m.j - m.i, 0);
+        const double r = sequence_ratio(shorter, longer.substr(start, shorter.size()), s);
+        if (r > partial_perfect)
+            return 100;
+
+        best = std::max(best, r);
+    }
+
+    return percent(best);
+}
+
+int partial_ratio(string_view a, string_view b, scratch &s, int cutoff)
+{
+    if (a == b)
+        return 100;
+    if (a.empty() || b.empty())
+        return 0;
+
+    if (a.size() > b.size())
+        std::swap(a, b);
+
+    if (cutoff > 0) {
+        s.needle.assign(a);
+        if (!window_may_reach(s.needle, b, s, cutoff))
+            return 0;
+    }
+
+    return exact_partial_ratio(a, b, s);
+}
+
+int partial_ratio(string_view a, const pattern &b, scratch &s, int cutoff)
+{
+    const string_view b_str = b.str();
+    if (a == b_str)
+        return 100;
+    if (a.empty() || b_str.empty())
+        return 0;
+
+    /* fuzzywuzzy takes the first as the shorter when they are equally long. */
+    if (a.size() <= b_str.size()) {
+        if (cutoff > 0) {
+            s.needle.assign(a);
+            if (!window_may_reach(s.needle, b_str, s, cutoff))
+                return 0;
+        }
+
+        return exact_partial_ratio(a, b_str, s);
+    }
+
+    if (cutoff > 0 && !window_may_reach(b, a, s, cutoff))
+        return 0;
+
+    return exact_partial_ratio(b_str, a, s);
+}
+
+/* Append the words to a space-separated string. */
+static void join(string &out, string_view word)
+{
+    if (!out.empty())
+        out.push_back(' ');
+
+    out.append(word.data(), word.size());
+}
+
+int token_set_ratio(const vector<string_view> &a, const vector<string_view> &b, scratch &s)
+{
+    if (a.empty() || b.empty())
+        return 0;
+
+    /* The shared words, and each string's words that aren't shared. */
+    s.sect.clear();
+    s.a_rest.clear();
+    s.b_rest.clear();
+
+    auto ia = a.cbegin(), ib = b.cbegin();
+    while (ia != a.cend() || ib != b.cend()) {
+        if (ib == b.cend() || (ia != a.cend() && *ia < *ib)) {
+            join(s.a_rest, *ia++);
+        } else if (ia == a.cend() || *ib < *ia) {
+            join(s.b_rest, *ib++);
+        } else {
+            join(s.sect, *ia++);
+            ib++;
+        }
+    }
+
+    /* Prefix the remainders with the shared words, and compare all three. */
+    for (string *rest : {&s.a_rest, &s.b_rest}) {
+        if (rest->empty())
+            rest->assign(s.sect);
+        else if (!s.sect.empty())
+            rest->insert(0, 1, ' ').insert(0, s.sect);
+    }
+
+    const string_view sect = s.sect, a_all = s.a_rest, b_all = s.b_rest;
+    return std::max({
+        ratio(sect, a_all, s),
+        ratio(sect, b_all, s),
+        ratio(a_all, b_all, s)
+    });
+}
+
+/* ns fuzzy */
+}
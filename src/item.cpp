@@ -16,19 +16,83 @@
  */
 
 #include <cctype>
-
-#include <fuzzywuzzy.hpp>
+#include <cstring>
+#include <algorithm>
 
 #include "item.hpp"
 #include "utils.hpp"
 #include "common.hpp"
-#include "algorithm.hpp"
-#include "functional.hpp"
-
-static constexpr int fuzzy_min = 75;
 
 namespace bookwyrm {
 
+/*
+ * Copy the strings the given function visits into one new buffer, point them at
+ * their copies, and return the buffer. Empty strings get nothing.
+ */
+template <typename ForEach>
+static std::unique_ptr<char[]> copy_strings(ForEach &&for_each)
+{
+    size_t size = 0;
+    for_each([&size](string_view &str) { size += str.size(); });
+
+    auto buffer = size == 0 ? nullptr : std::make_unique<char[]>(size);
+    char *dest = buffer.get();
+    for_each([&dest](string_view &str) {
+        if (str.empty()) {
+            str = string_view();
+            return;
+        }
+
+        std::memcpy(dest, str.data(), str.size());
+        str = string_view(dest, str.size());
+        dest += str.size();
+    });
+
+    return buffer;
+}
+
+exacts_t::exacts_t(const std::map<string, int> &dict, const string &extension)
+    : ymod_(year_mod::unused),
+    year_(get_value(dict, "year")),
+    edition_(get_value(dict, "edition")),
+    volume_(get_value(dict, "volume")),
+    number_(get_value(dict, "number")),
+    pages_(get_value(dict, "pages")),
+    extension_(extension)
+{
+    own();
+}
+
+exacts_t::exacts_t(const std::pair<year_mod, int> &pair, const cliparser &cli)
+    : ymod_(std::get<0>(pair)), year_(std::get<1>(pair)),
+    edition_(parse_number(cli, "edition")),
+    volume_(parse_number(cli, "volume")),
+    number_(parse_number(cli, "number")),
+    pages_(parse_number(cli, "pages"))
+{
+    const auto extension = cli.get("extension");
+    extension_ = extension;
+    own();
+}
+
+exacts_t::exacts_t(const exacts_t &other)
+    : ymod_(other.ymod_), year_(other.year_), edition_(other.edition_), volume_(other.volume_),
+    number_(other.number_), pages_(other.pages_), extension_(other.extension_)
+{
+    own();
+}
+
+void exacts_t::own()
+{
+    buffer_ = copy_strings([this](auto &&visit) { visit(extension_); });
+}
+
+void exacts_t::keep(string_pool &pool)
+{
+    extension_ = pool.intern(extension_);
+    buffer_.reset();
+}
+
 int exacts_t::parse_number(const cliparser &cli, const string &&opt)
 {
     const auto value_str = cli.get(opt);
@@ -92,76 +156,154 @@ const std::pair<year_mod, int> exacts_t::get_yearmod(const cliparser &cli)
     }
 }
 
-const string nonexacts_t::get_value(const std::map<string, string> &dict, const string &&key)
+nonexacts_t::nonexacts_t(const cliparser &cli)
+    : nonexacts_t({
+        {"title", cli.get("title")},
+        {"series", cli.get("series")},
+        {"publisher", cli.get("publisher")},
+        {"journal", cli.get("journal")}
+    }, cli.get_many("author")) {}
+
+nonexacts_t::nonexacts_t(const std::map<string, string> &dict, const vector<string> &authors)
+    : authors_(authors.cbegin(), authors.cend()),
+    title_(get_value(dict, "title")),
+    series_(get_value(dict, "series")),
+    publisher_(get_value(dict, "publisher")),
+    journal_(get_value(dict, "journal"))
 {
-    const auto elem = dict.find(key);
-    return elem == dict.cend() ? "" : elem->second;
+    own();
+}
+
+nonexacts_t::nonexacts_t(const nonexacts_t &other)
+    : authors_(other.authors_), title_(other.title_), series_(other.series_),
+    publisher_(other.publisher_), journal_(other.journal_)
+{
+    own();
 }
 
-bool item::matches(const item &wanted) const
+void nonexacts_t::own()
 {
-    // TODO: implement operator== for exacts_t?
+    buffer_ = copy_strings([this](auto &&visit) {
+        for (auto &author : authors_)
+            visit(author);
 
-    /* Return false if any exact value doesn't match what's wanted. */
-    for (const auto& [req, got] : func::zip(wanted.exacts.store, this->exacts.store)) {
-        if (req != empty && req != got)
-            return false;
-    }
+        for (auto *field : {&title_, &series_, &publisher_, &journal_})
+            visit(*field);
+    });
+}
 
-    /* Ad-hoc the file type, for now. */
-    if (!wanted.exacts.extension.empty()) {
-        if (this->exacts.extension != wanted.exacts.extension)
-            return false;
-    }
+void nonexacts_t::keep(string_pool &pool)
+{
+    for (auto &author : authors_)
+        author = pool.intern(author);
+
+    publisher_ = pool.intern(publisher_);
+    journal_ = pool.intern(journal_);
+
+    /* Drops the copies of what was just interned. */
+    buffer_ = copy_strings([this](auto &&visit) {
+        visit(title_);
+        visit(series_);
+    });
+}
+
+string_view nonexacts_t::get_value(const std::map<string, string> &dict, const string &&key)
+{
+    const auto elem = dict.find(key);
+    return elem == dict.cend() ? string_view() : string_view(elem->second);
+}
+
+misc_t::misc_t(const vector<string> &uris, const vector<string> &isbns)
+    : uris_(uris.cbegin(), uris.cend()), isbns_(isbns.cbegin(), isbns.cend())
+{
+    own();
+}
+
+misc_t::misc_t(const misc_t &other)
+    : uris_(other.uris_), isbns_(other.isbns_)
+{
+    own();
+}
 
-    /* Does the item contain a wanted ISBN? */
-    if (!wanted.misc.isbns.empty() &&
-            !utils::any_intersection(wanted.misc.isbns, this->misc.isbns))
-        return false;
-
-    const std::array<string, 3> in_result = {{
-                                    this->nonexacts.title,
-                                    this->nonexacts.series,
-                                    this->nonexacts.publisher
-                                }},
-                                requested = {{
-                                    wanted.nonexacts.title,
-                                    wanted.nonexacts.series,
-                                    wanted.nonexacts.publisher
-                                }};
-
-    for (const auto& [req, got] : func::zip(requested, in_result)) {
-        if (!req.empty()) {
-            /*
-             * partial: useful for course literature that can have some
-             * crazy long titles. Also useful for publishers, because
-             * some entries may not use the full name.
-             */
-            if (fuzz::partial_ratio(got, req) < fuzzy_min)
-                return false;
+void misc_t::own()
+{
+    buffer_ = copy_strings([this](auto &&visit) {
+        for (auto *strs : {&uris_, &isbns_}) {
+            for (auto &str : *strs)
+                visit(str);
         }
+    });
+}
+
+mirror_list::mirror_list(const mirror_list &other)
+{
+    /* Keep the order: rebuild from the oldest. */
+    for (const auto &uri : other.get())
+        add(uri);
+}
+
+mirror_list::~mirror_list()
+{
+    for (const node *n = head_.load(std::memory_order_relaxed); n; ) {
+        const node *next = n->next;
+        delete n;
+        n = next;
     }
+}
 
-    if (!wanted.nonexacts.authors.empty()) {
-        int max_ratio = 0;
-        for (const auto& [req, got] : algorithm::product(wanted.nonexacts.authors,
-                    this->nonexacts.authors)) {
-            /*
-             * From some quick testing, it feels like token_set_ratio
-             * works best here.
-             */
-            int ratio = fuzz::token_set_ratio(req, got);
-            max_ratio = std::max(ratio, max_ratio);
-
-            if (max_ratio >= fuzzy_min)
-                break;
-        }
+void mirror_list::add(const string_view &uri)
+{
+    const node *n = new node{string(uri), head_.load(std::memory_order_relaxed)};
+    head_.store(n, std::memory_order_release);
+}
+
+vector<string_view> mirror_list::get() const
+{
+    vector<string_view> uris;
+    for (const node *n = head_.load(std::memory_order_acquire); n; n = n->next)
+        uris.push_back(n->uri);
+
+    std::reverse(uris.begin(), uris.end());
+    return uris;
+}
+
+vector<string> item::all_uris() const
+{
+    vector<string> uris(misc_.uris().cbegin(), misc_.uris().cend());
+    for (const auto &uri : mirrors_.get())
+        uris.emplace_back(uri);
+
+    return uris;
+}
+
+bool item::add_mirrors(const item &duplicate)
+{
+    auto known = all_uris();
 
-        if (max_ratio < fuzzy_min)
-            return false;
+    bool added = false;
+    for (const auto &uri : duplicate.misc_.uris()) {
+        if (std::find(known.cbegin(), known.cend(), uri) != known.cend())
+            continue;
+
+        mirrors_.add(uri);
+        known.emplace_back(uri);
+        added = true;
     }
 
-    return true;
+    return added;
+}
+
+void item::own()
+{
+    nonexacts_.own();
+    exacts_.own();
+    misc_.own();
+}
+
+void item::keep(string_pool &pool)
+{
+    nonexacts_.keep(pool);
+    exacts_.keep(pool);
 }
 
 /* ns bookwyrm */
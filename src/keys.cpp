@@ -23,10 +23,10 @@ static tb_event tb_ev;
 
 namespace keys {
 
-bool poll_event(event &ev)
+int peek_event(event &ev, int timeout)
 {
-    if (!tb_poll_event(&tb_ev))
-        return false;
+    if (const int res = tb_peek_event(&tb_ev, timeout); res <= 0)
+        return res;
 
     ev.type = type(tb_ev.type);
     ev.key  = key(tb_ev.key);
@@ -37,7 +37,7 @@ bool poll_event(event &ev)
     ev.x    = tb_ev.x;
     ev.y    = tb_ev.y;
 
-    return true;
+    return tb_ev.type;
 }
 
 /* ns keys */
@@ -47,7 +47,16 @@ int main(int argc, char *argv[])
     const auto misc = cligroup("Miscellaneous")
         ("-h", "--help",       "Display this text and exit")
         ("-v", "--version",    "Print version information (" + build_info_short + ") and exit")
-        ("-D", "--debug",      "Set logging level to debug");
+        ("-D", "--debug",      "Set logging level to debug")
+        ("-j", "--jobs",       "Download at most N items in parallel (default: 4)", "N")
+        ("-J", "--host-jobs",  "Open at most N connections to the same host (default: 2)", "N")
+        ("-S", "--segments",   "Download large files in up to N parallel parts (default: 4)", "N")
+        ("-r", "--refresh-rate", "Repaint the TUI at most HZ times a second (default: 60)", "HZ")
+        ("-b", "--backpressure", "What seekers do when they find items faster than they can be handled: "
+                               "block or drop (default: block)", "POLICY")
+        ("-k", "--top",        "Only keep the K best matches found (default: keep all)", "K")
+        ("-w", "--workers",    "Run seekers as threads, or as processes of their own "
+                               "which may use all cores (default: threads)", "MODE");
 
     const cligroups groups = {main, excl, exact, misc};
 
@@ -78,8 +87,34 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    int jobs, host_jobs, segments, refresh_rate, top;
+    auto when_full = butler::backpressure::block;
+    auto seekers_in = butler::seeker_mode::threads;
+
     try {
         cli.validate_arguments();
+
+        jobs = cli.get_number("jobs", 4);
+        host_jobs = cli.get_number("host-jobs", 2);
+        segments = cli.get_number("segments", 4);
+        refresh_rate = cli.get_number("refresh-rate", 60);
+        top = cli.get_number("top", 0);
+
+        if (cli.has("backpressure")) {
+            if (const auto policy = cli.get("backpressure"); policy == "drop")
+                when_full = butler::backpressure::drop;
+            else if (policy != "block")
+                throw value_error("malformed value '" + policy + "' for argument --backpressure"
+                        "; block or drop is expected");
+        }
+
+        if (cli.has("workers")) {
+            if (const auto mode = cli.get("workers"); mode == "processes")
+                seekers_in = butler::seeker_mode::processes;
+            else if (mode != "threads")
+                throw value_error("malformed value '" + mode + "' for argument --workers"
+                        "; threads or processes is expected");
+        }
     } catch (const argument_error &err) {
         fmt::print(stderr, "error: {}; see --help\n", err.what());
         return EXIT_FAILURE;
@@ -92,8 +127,8 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    bookwyrm::downloader d(cli.get(0));
-    vector<bookwyrm::item> wanted_items;
+    auto d = std::make_shared<bookwyrm::downloader>(cli.get(0), jobs, host_jobs, segments);
+    size_t wanted_items = 0;
 
     try {
         auto logger = logger::create("main");
@@ -112,21 +147,27 @@ int main(int argc, char *argv[])
          * During run-time, the butler will match each found item
          * with the wanted one. If it doesn't match, it is discarded.
          */
-        const bookwyrm::item wanted(cli);
-        auto butler = butler::script_butler(std::move(wanted), logger);
+        bookwyrm::item wanted(cli);
+        auto butler = butler::script_butler(std::move(wanted), logger, when_full, top, seekers_in);
 
         auto seekers = butler.load_seekers();
-        auto tui = tui::make_with(butler, seekers, logger);
+        auto tui = tui::make_with(butler, seekers, logger, refresh_rate);
+
+        /* Items are downloaded as soon as they are marked, while the user keeps browsing. */
+        tui->set_downloader(d);
+        d->async_download(logger, [tui = std::weak_ptr(tui)]() {
+            if (auto screen = tui.lock(); screen)
+                screen->repaint_screens();
+        });
 
         py::gil_scoped_release nogil;
 
         if (tui->display()) {
-            /*
-             * Start download while script_butler destructs.
-             * NOTE: the TUI is blocked here; we don't want that.
-             */
-            /* d.async_download(tui->get_wanted_items()); */
-            wanted_items = tui->get_wanted_items();
+            /* Downloads continue while script_butler destructs. */
+            wanted_items = tui->wanted_item_count();
+            d->detach();
+        } else {
+            d->cancel_all();
         }
 
     } catch (const component_error &err) {
@@ -137,20 +178,20 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    if (wanted_items.empty()) {
+    if (wanted_items == 0) {
         /* We have nothing else to do. */
         return EXIT_SUCCESS;
     }
 
     try {
-        if (wanted_items.size() == 1)
+        if (wanted_items == 1)
             fmt::print("Downloading item...\n");
         else
-            fmt::print("Downloading {} items...\n", wanted_items.size());
+            fmt::print("Downloading {} items...\n", wanted_items);
 
-        auto success = d.sync_download(wanted_items);
+        auto success = d->wait();
 
-        if (!success && wanted_items.size() > 1) {
+        if (!success && wanted_items > 1) {
             fmt::print("No items were successfully downloaded\n");
             return EXIT_FAILURE;
         }
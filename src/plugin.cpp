@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <dlfcn.h>
+
+#include "errors.hpp"
+#include "plugin.hpp"
+
+/* The year modifiers of seeker_plugin.h are ours, as is. */
+static_assert(BOOKWYRM_YEAR_EQUAL == static_cast<int>(bookwyrm::year_mod::equal) &&
+        BOOKWYRM_YEAR_EQ_GT == static_cast<int>(bookwyrm::year_mod::eq_gt) &&
+        BOOKWYRM_YEAR_EQ_LT == static_cast<int>(bookwyrm::year_mod::eq_lt) &&
+        BOOKWYRM_YEAR_LT == static_cast<int>(bookwyrm::year_mod::lt) &&
+        BOOKWYRM_YEAR_GT == static_cast<int>(bookwyrm::year_mod::gt),
+        "year modifiers differ from seeker_plugin.h");
+
+namespace bookwyrm {
+
+static bookwyrm_str to_str(const string_view &str)
+{
+    return {str.data(), str.size()};
+}
+
+static string_view to_view(const bookwyrm_str &str)
+{
+    return str.size == 0 ? string_view() : string_view(str.data, str.size);
+}
+
+static vector<string_view> to_views(const bookwyrm_strs &strs)
+{
+    vector<string_view> views;
+    views.reserve(strs.size);
+    for (size_t i = 0; i < strs.size; i++)
+        views.push_back(to_view(strs.data[i]));
+
+    return views;
+}
+
+plugin::plugin(const fs::path &path)
+{
+    handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle_)
+        throw program_error(dlerror());
+
+    using entry_t = const bookwyrm_seeker *(*)();
+    const auto entry = reinterpret_cast<entry_t>(dlsym(handle_, "bookwyrm_plugin"));
+
+    seeker_ = entry ? entry() : nullptr;
+    if (!seeker_) {
+        dlclose(handle_);
+        throw program_error("not a seeker plugin");
+    }
+
+    if (seeker_->abi != BOOKWYRM_SEEKER_ABI) {
+        const auto abi = seeker_->abi;
+        dlclose(handle_);
+        throw program_error("built for seeker ABI " + std::to_string(abi) + ", but we speak "
+                + std::to_string(BOOKWYRM_SEEKER_ABI));
+    }
+
+    if (seeker_->name) {
+        name_ = seeker_->name;
+    } else {
+        name_ = path.filename().string();
+        name_.resize(name_.size() - std::min(name_.size(), std::strlen(BOOKWYRM_SEEKER_SUFFIX)));
+    }
+}
+
+bool plugin::is_plugin(const fs::path &path)
+{
+    const string name = path.filename().string();
+    const size_t suffix = std::strlen(BOOKWYRM_SEEKER_SUFFIX);
+
+    return name.size() > suffix && name.compare(name.size() - suffix, suffix, BOOKWYRM_SEEKER_SUFFIX) == 0;
+}
+
+plugin::~plugin()
+{
+    if (handle_)
+        dlclose(handle_);
+}
+
+plugin::plugin(plugin &&other) noexcept
+    : handle_(other.handle_), seeker_(other.seeker_), name_(std::move(other.name_))
+{
+    other.handle_ = nullptr;
+}
+
+plugin::query::query(const item &wanted)
+{
+    for (const auto &author : wanted.nonexacts().authors())
+        authors_.push_back(to_str(author));
+    for (const auto &uri : wanted.misc().uris())
+        uris_.push_back(to_str(uri));
+    for (const auto &isbn : wanted.misc().isbns())
+        isbns_.push_back(to_str(isbn));
+
+    const auto &n = wanted.nonexacts();
+    const auto &e = wanted.exacts();
+    query_ = {
+        {authors_.data(), authors_.size()},
+        to_str(n.title()), to_str(n.series()), to_str(n.publisher()), to_str(n.journal()),
+        e.year(), e.edition(), e.volume(), e.number(), e.pages(),
+        to_str(e.extension()),
+        static_cast<int32_t>(e.ymod()),
+        {uris_.data(), uris_.size()}, {isbns_.data(), isbns_.size()}
+    };
+}
+
+item plugin::to_item(const bookwyrm_item &fed)
+{
+    return item(std::make_tuple(
+        nonexacts_t(to_views(fed.authors), to_view(fed.title), to_view(fed.series),
+            to_view(fed.publisher), to_view(fed.journal)),
+        exacts_t(fed.year, fed.edition, fed.volume, fed.number, fed.pages, to_view(fed.extension)),
+        misc_t(to_views(fed.uris), to_views(fed.isbns))));
+}
+
+/* ns bookwyrm */
+}
@@ -16,6 +16,10 @@
  */
 
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <fmt/format.h>
 
@@ -24,6 +28,7 @@
 namespace screen {
 
 int base::screen_count_ = 0;
+int base::tty_fd_ = -1;
 
 base::base(int pad_top, int pad_bot, int pad_left, int pad_right)
     : padding_top_(pad_top), padding_bot_(pad_bot),
@@ -34,7 +39,10 @@ base::base(int pad_top, int pad_bot, int pad_left, int pad_right)
 
 base::~base()
 {
-    if (--screen_count_ == 0) tb_shutdown();
+    if (--screen_count_ == 0) {
+        tb_shutdown();
+        tty_fd_ = -1;
+    }
     assert(screen_count_ >= 0);
 }
 
@@ -66,8 +74,17 @@ void base::init_tui()
 {
     if (screen_count_++ > 0) return;
 
-    int code = tb_init();
+    /* Open the terminal ourselves (like tb_init() would), so that we may poll it. */
+    tty_fd_ = open("/dev/tty", O_RDWR);
+    if (tty_fd_ < 0) {
+        string err = fmt::format("unable to open the terminal: {}", std::strerror(errno));
+        throw component_error(err.data());
+    }
+
+    /* Termbox closes the terminal when shut down. */
+    int code = tb_init_fd(tty_fd_);
     if (code < 0) {
+        close(tty_fd_);
         string err = fmt::format("termbox init failed with code: {}", code);
         throw component_error(err.data());
     }
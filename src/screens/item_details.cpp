@@ -63,18 +63,18 @@ void item_details::print_borders()
 
 void item_details::print_details()
 {
-    const string uris = utils::vector_to_string(item_.misc.uris);
+    const string uris = utils::vector_to_string(item_.all_uris());
 
-    using pair = std::pair<string, std::reference_wrapper<const string>>;
-    string authors = utils::vector_to_string(item_.nonexacts.authors);
-    string year = std::to_string(item_.exacts.year);
+    using pair = std::pair<string, string_view>;
+    string authors = utils::vector_to_string(item_.nonexacts().authors());
+    string year = std::to_string(item_.exacts().year());
     const vector<pair> v = {
-        {"Title",     item_.nonexacts.title},
-        {"Serie",     item_.nonexacts.series},
+        {"Title",     item_.nonexacts().title()},
+        {"Serie",     item_.nonexacts().series()},
         {"Authors",   authors},
         {"Year",      year},
-        {"Publisher", item_.nonexacts.publisher},
-        {"Extension", item_.exacts.extension},
+        {"Publisher", item_.nonexacts().publisher()},
+        {"Extension", item_.exacts().extension()},
         {"URI",       uris},
         // include filesize here
         // and print it red if the item is gigabytes large
@@ -92,7 +92,7 @@ void item_details::print_details()
     int y = 1;
     for (const auto &p : v) {
         wprint(0, y, p.first + ':', attribute::bold);
-        wprint(len + 4, y++, p.second.get());
+        wprint(len + 4, y++, p.second);
     }
 
     wprint(0, ++y, "Description:", attribute::bold);
@@ -21,6 +21,7 @@
 #include "python.hpp"
 #include "screens/multiselect_menu.hpp"
 #include "screens/item_details.hpp"
+#include "components/downloader.hpp"
 
 namespace screen {
 
@@ -33,10 +34,10 @@ void multiselect_menu::columns_t::operator=(vector<std::pair<string, column_t::w
     }
 }
 
-multiselect_menu::multiselect_menu(vector<bookwyrm::item> const &items)
+multiselect_menu::multiselect_menu(bookwyrm::item_store const &items, bookwyrm::top_items *top)
     : base(default_padding_top, default_padding_bot, default_padding_left, default_padding_right),
     selected_item_(0), scroll_offset_(0),
-    items_(items)
+    items_(items), top_(top)
 {
     /*
      * These wanted widths works fine for now,
@@ -52,6 +53,7 @@ multiselect_menu::multiselect_menu(vector<bookwyrm::item> const &items)
         {"Authors",    .20},
         {"Publisher",  .15},
         {"Format",      6 },
+        {"Status",      6 },
     };
 
     update_column_widths();
@@ -59,13 +61,17 @@ multiselect_menu::multiselect_menu(vector<bookwyrm::item> const &items)
 
 void multiselect_menu::paint()
 {
+    /* Items may be added while we paint; stick to those listed now, so that all columns agree. */
+    rank_new_items();
+    const size_t count = item_count();
+
     for (size_t idx = 0; idx < columns_.size(); idx++) {
         /* Can we fit another column? */
         const size_t allowed_width = get_width() - 1 + padding_left_
                                    - columns_[idx].startx - 2;
         if (columns_[idx].width > allowed_width) break;
 
-        print_column(idx);
+        print_column(idx, count);
     }
 
     print_header();
@@ -89,6 +95,66 @@ int multiselect_menu::scrollpercent() const
     return utils::ratio(menu_capacity() + scroll_offset_, item_count());
 }
 
+void multiselect_menu::rank_new_items()
+{
+    if (!top_) {
+        /* Every item found is kept, and only ever appended. */
+        for (size_t idx = ranking_.size(), found = items_.size(); idx < found; idx++)
+            list_item(idx);
+
+        return;
+    }
+
+    top_->follow([this](size_t idx) { list_item(idx); },
+                 [this](size_t idx) { evicted_.insert(idx); });
+
+    /* Let go of evicted items, once the user doesn't care about them. */
+    for (auto it = evicted_.begin(); it != evicted_.end(); ) {
+        if (is_pinned(*it)) {
+            it++;
+            continue;
+        }
+
+        unlist_item(*it);
+        top_->release(*it);
+        it = evicted_.erase(it);
+    }
+}
+
+void multiselect_menu::list_item(const size_t idx)
+{
+    const size_t row = ranking_.insert({-items_[idx].score(), idx});
+
+    /* Keep the same item selected, and in view, as better ones turn up above it. */
+    if (ranking_.size() > 1 && row <= selected_item_) {
+        selected_item_++;
+        if (selected_item_ >= scroll_offset_ + menu_capacity())
+            scroll_offset_++;
+    }
+}
+
+void multiselect_menu::unlist_item(const size_t idx)
+{
+    const size_t row = ranking_.erase({-items_[idx].score(), idx});
+
+    /* The selected item is pinned, so it is never the one unlisted. */
+    if (row < selected_item_) {
+        selected_item_--;
+        if (row < scroll_offset_)
+            scroll_offset_--;
+    }
+}
+
+bool multiselect_menu::is_pinned(const size_t idx) const
+{
+    /* The item details screen shows the selected item. */
+    if (item_count() > 0 && item_at(selected_item_) == idx)
+        return true;
+
+    /* Downloads are told apart by index, which must not be reused meanwhile. */
+    return is_marked(idx) || (downloader_ && downloader_->status(idx));
+}
+
 bool multiselect_menu::is_marked(const size_t idx) const
 {
     return marked_items_.find(idx) != marked_items_.cend();
@@ -135,24 +201,58 @@ void multiselect_menu::move(move_direction dir)
     }
 }
 
+string multiselect_menu::download_status(const size_t idx) const
+{
+    if (!downloader_) return "";
+
+    const auto status = downloader_->status(idx);
+    if (!status) return "";
+
+    using state = bookwyrm::transfer::status;
+    switch (status->state) {
+        case state::queued:
+            return "queued";
+        case state::probing:
+            return "racing";
+        case state::single:
+        case state::segmented:
+            if (status->size <= 0) return "...";
+            return fmt::format("{}%", utils::ratio(status->written, status->size));
+        case state::done:
+            return "done";
+        case state::failed:
+            return "failed";
+    }
+
+    return "";
+}
+
 void multiselect_menu::mark_item(const size_t idx)
 {
     marked_items_.insert(idx);
+
+    if (downloader_)
+        downloader_->enqueue(idx, items_[idx]);
 }
 
 void multiselect_menu::unmark_item(const size_t idx)
 {
     marked_items_.erase(idx);
+
+    if (downloader_)
+        downloader_->cancel(idx);
 }
 
 void multiselect_menu::toggle_action()
 {
     /* Toggle item selection. */
+    if (item_count() == 0) return;
 
-    if (is_marked(selected_item_))
-        unmark_item(selected_item_);
+    const size_t idx = item_at(selected_item_);
+    if (is_marked(idx))
+        unmark_item(idx);
     else
-        mark_item(selected_item_);
+        mark_item(idx);
 }
 
 void multiselect_menu::update_column_widths()
@@ -217,15 +317,16 @@ void multiselect_menu::print_header()
     }
 }
 
-void multiselect_menu::print_column(const size_t col_idx)
+void multiselect_menu::print_column(const size_t col_idx, const size_t count)
 {
     const auto &c = columns_[col_idx];
 
-    for (size_t i = scroll_offset_, y = 1; i < item_count() &&
+    for (size_t i = scroll_offset_, y = 1; i < count &&
             y <= menu_capacity(); i++, y++) {
 
+        const size_t idx = item_at(i);
         const bool on_selected_item = (y + scroll_offset_ == selected_item_ + 1),
-                   on_marked_item   = is_marked(y + scroll_offset_ - 1);
+                   on_marked_item   = is_marked(idx);
 
         /*
          * Print the indicator, indicating which item is
@@ -240,19 +341,22 @@ void multiselect_menu::print_column(const size_t col_idx)
 
         const attribute attrs = (on_selected_item || on_marked_item) ? attribute::reverse : attribute::none;
 
-        const string authors = utils::vector_to_string(items_[i].nonexacts.authors);
-        const string year = std::to_string(items_[i].exacts.year);
-        const std::array<std::reference_wrapper<const string>, 6> strings = {{
-            items_[i].nonexacts.title,
+        const auto &item = items_[idx];
+        const string authors = utils::vector_to_string(item.nonexacts().authors());
+        const string year = std::to_string(item.exacts().year());
+        const string status = col_idx == 6 ? download_status(idx) : "";
+        const std::array<string_view, 7> strings = {{
+            item.nonexacts().title(),
             year,
-            items_[i].nonexacts.series,
+            item.nonexacts().series(),
             authors,
-            items_[i].nonexacts.publisher,
-            items_[i].exacts.extension
+            item.nonexacts().publisher(),
+            item.exacts().extension(),
+            status
         }};
 
         /* Print the string, check if it was truncated. */
-        const int trunc_len = wprintlim(c.startx, y, strings[col_idx].get(), c.width, attrs);
+        const int trunc_len = wprintlim(c.startx, y, strings[col_idx], c.width, attrs);
 
         /*
          * Fill the space between the two column strings with inverted spaces.
@@ -262,7 +366,7 @@ void multiselect_menu::print_column(const size_t col_idx)
          * and write until the end of the column, plus seperator and the padding on the right
          * side of it (e.g. up to and including the first char in the next column, hence the magic).
          */
-        const auto string_end = c.startx + strings[col_idx].get().length() - trunc_len,
+        const auto string_end = c.startx + strings[col_idx].length() - trunc_len,
                    next_start = c.startx + c.width + 2;
         for (auto x = string_end; x <= next_start; x++)
             change_cell(x, y, ' ', attrs);
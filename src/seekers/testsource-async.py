@@ -0,0 +1,24 @@
+import pybookwyrm as bw
+import asyncio
+
+
+async def find(wanted, bookwyrm):
+    # Runs on an event loop shared with the other async seekers,
+    # so wait with await instead of blocking (e.g. time.sleep).
+    # When bookwyrm terminates, the coroutine is cancelled
+    # (asyncio.CancelledError is raised wherever it awaits).
+
+    # Generate some dummy data
+    for i in range(10):
+        await asyncio.sleep(0.2)
+
+        nonexacts = bw.nonexacts_t(
+            {'series': 'series' + str(i), 'title': 'Some Title (' + str(i) + ')'},
+            ['Author A. ' + str(i), 'Author B.' + str(i)])
+
+        exacts = bw.exacts_t({'year': 2000 + i, 'pages': 500 + i}, 'pdf')
+
+        misc = bw.misc_t(['http://localhost:8000/helloworld.txt'], ['isbn'])
+
+        book = (nonexacts, exacts, misc)
+        await bookwyrm.afeed(book)
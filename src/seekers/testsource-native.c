@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The native counterpart of testsource.py. Built into the build tree, where Debug builds
+ * find it (see CMakeLists.txt); or by hand, next to testsource.py, with
+ *   cc -shared -fPIC -I ../../include -o testsource-native.seeker.so testsource-native.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "seeker_plugin.h"
+
+#define BOOKS 100
+
+static struct bookwyrm_str str(const char *s)
+{
+    struct bookwyrm_str str = {s, strlen(s)};
+    return str;
+}
+
+static void find(const struct bookwyrm_item *wanted, const struct bookwyrm_sink *sink)
+{
+    static char titles[BOOKS][32], series[BOOKS][32], authors[BOOKS][2][32];
+    struct bookwyrm_str author_strs[BOOKS][2];
+    struct bookwyrm_item books[BOOKS];
+
+    const struct bookwyrm_str uris[] = {
+        str("http://localhost:8000/big"),
+        str("http://localhost:8000/invalidurl.txt"),
+        str("http://localhost:8000/helloworld.txt")
+    };
+    const struct bookwyrm_str isbns[] = {str("isbn1"), str("isbn2")};
+
+    (void)wanted;
+    sink->log(sink->context, BOOKWYRM_LOG_DEBUG, str("generating some dummy items"));
+
+    /* Generate some dummy items, and feed them all at once. */
+    for (int i = 0; i < BOOKS; i++) {
+        if (sink->terminating(sink->context))
+            return;
+
+        snprintf(titles[i], sizeof(titles[i]), "Some Title (%d)", i);
+        snprintf(series[i], sizeof(series[i]), "The Cool Series%d", i);
+        snprintf(authors[i][0], sizeof(authors[i][0]), "Author A. %d", i);
+        snprintf(authors[i][1], sizeof(authors[i][1]), "Author B.%d", i);
+        author_strs[i][0] = str(authors[i][0]);
+        author_strs[i][1] = str(authors[i][1]);
+
+        struct bookwyrm_item *book = &books[i];
+        memset(book, 0, sizeof(*book));
+
+        book->authors.data = author_strs[i];
+        book->authors.size = 2;
+        book->title = str(titles[i]);
+        book->series = str(series[i]);
+        book->publisher = str("Fuck Pearson");
+        book->journal = str("No journal, no");
+
+        book->year = 2000 + i;
+        book->edition = i;
+        book->volume = i;
+        book->number = 30 + i;
+        book->pages = 500 + i;
+        book->extension = str("pdf");
+
+        book->uris.data = uris;
+        book->uris.size = 3;
+        book->isbns.data = isbns;
+        book->isbns.size = 2;
+    }
+
+    sink->feed(sink->context, books, BOOKS);
+}
+
+const struct bookwyrm_seeker *bookwyrm_plugin(void)
+{
+    static const struct bookwyrm_seeker seeker = {BOOKWYRM_SEEKER_ABI, "testsource-native", find};
+    return &seeker;
+}
@@ -3,11 +3,11 @@ import time
 
 
 def find(wanted, bookwyrm):
-    # Changes to wanted are module-local
-    # since the item is copied.
-    # wanted.nonexacts.title = "new title"
+    # wanted is read-only:
+    # wanted.nonexacts.title = "new title" raises an AttributeError.
 
-    # Generate some dummy items
+    # Generate some dummy items, and feed them all at once
+    books = []
     for i in range(100):
         if bookwyrm.terminating():
             return
@@ -38,5 +38,6 @@ def find(wanted, bookwyrm):
             'http://localhost:8000/helloworld.txt'
         ], ['isbn1', 'isbn2'])
 
-        book = (nonexacts, exacts, misc)
-        bookwyrm.feed(book)
+        books.append((nonexacts, exacts, misc))
+
+    bookwyrm.feed_many(books)
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "errors.hpp"
+#include "shm_ring.hpp"
+
+/* Marks the rest of the ring, up to its end, as skipped. */
+static constexpr uint32_t skip_marker = UINT32_MAX;
+
+static constexpr size_t round_up(size_t n)
+{
+    return (n + 3) & ~size_t(3);
+}
+
+namespace bookwyrm {
+
+shm_ring::shm_ring(size_t capacity)
+{
+    capacity_ = 64;
+    while (capacity_ < capacity) capacity_ *= 2;
+
+    void *mem = mmap(nullptr, sizeof(header) + capacity_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw program_error(string("can't map shared memory: ") + std::strerror(errno));
+
+    readable_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    writable_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readable_fd_ == -1 || writable_fd_ == -1) {
+        const string err = std::strerror(errno);
+        if (readable_fd_ != -1) ::close(readable_fd_);
+        munmap(mem, sizeof(header) + capacity_);
+        throw program_error("can't create eventfd: " + err);
+    }
+
+    header_ = new (mem) header();
+    data_ = static_cast<char*>(mem) + sizeof(header);
+}
+
+shm_ring::~shm_ring()
+{
+    ::close(readable_fd_);
+    ::close(writable_fd_);
+    munmap(header_, sizeof(header) + capacity_);
+}
+
+size_t shm_ring::max_record() const
+{
+    /* Any record no larger than half the ring fits once the reader has caught up, wherever it starts. */
+    return capacity_ / 2 - sizeof(uint32_t);
+}
+
+bool shm_ring::try_write(const string_view &record)
+{
+    const size_t size = sizeof(uint32_t) + round_up(record.size());
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    const uint64_t tail = header_->tail.load();
+
+    size_t offset = head & (capacity_ - 1);
+    const size_t to_end = capacity_ - offset;
+    const bool wraps = size > to_end;
+
+    if (head - tail + (wraps ? to_end : 0) + size > capacity_)
+        return false;
+
+    if (wraps) {
+        std::memcpy(data_ + offset, &skip_marker, sizeof(skip_marker));
+        head += to_end;
+        offset = 0;
+    }
+
+    const uint32_t length = record.size();
+    std::memcpy(data_ + offset, &length, sizeof(length));
+    std::memcpy(data_ + offset + sizeof(length), record.data(), record.size());
+
+    /* Publish it; then, should the reader be waiting, wake it. */
+    header_->head.store(head + size);
+    if (header_->reader_waiting.load())
+        wake(readable_fd_);
+
+    return true;
+}
+
+bool shm_ring::write(const string_view &record, int timeout_ms)
+{
+    if (record.size() > max_record())
+        return false;
+
+    if (try_write(record))
+        return true;
+
+    /* Say we wait before the last look, so that the reader can't make room unnoticed. */
+    header_->writer_waiting.store(1);
+
+    bool written = try_write(record);
+    if (!written && !closed()) {
+        pollfd p = {writable_fd_, POLLIN, 0};
+        poll(&p, 1, timeout_ms);
+
+        uint64_t count;
+        while (read(writable_fd_, &count, sizeof(count)) == -1 && errno == EINTR);
+        written = try_write(record);
+    }
+
+    header_->writer_waiting.store(0);
+    return written;
+}
+
+bool shm_ring::write_or_prepare_wait(const string_view &record)
+{
+    if (try_write(record))
+        return true;
+
+    /* As in write: the reader makes room after this, and so wakes us, or we find it now. */
+    header_->writer_waiting.store(1);
+    if (try_write(record)) {
+        header_->writer_waiting.store(0);
+        return true;
+    }
+
+    return false;
+}
+
+void shm_ring::done_waiting_to_write()
+{
+    header_->writer_waiting.store(0);
+
+    uint64_t count;
+    while (read(writable_fd_, &count, sizeof(count)) == -1 && errno == EINTR);
+}
+
+std::optional<string_view> shm_ring::peek()
+{
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    const uint64_t head = header_->head.load();
+
+    if (tail == head)
+        return std::nullopt;
+
+    size_t offset = tail & (capacity_ - 1);
+    uint32_t length;
+    std::memcpy(&length, data_ + offset, sizeof(length));
+
+    if (length == skip_marker) {
+        tail += capacity_ - offset;
+        offset = 0;
+        std::memcpy(&length, data_, sizeof(length));
+    }
+
+    /* The writer is a process of its own, which might have gone haywire. */
+    if (length > max_record() || offset + sizeof(length) + length > capacity_)
+        throw value_error("corrupt record in shared memory");
+
+    pending_ = tail + sizeof(length) + round_up(length);
+    return string_view(data_ + offset + sizeof(length), length);
+}
+
+void shm_ring::release()
+{
+    header_->tail.store(pending_);
+    if (header_->writer_waiting.load())
+        wake(writable_fd_);
+}
+
+bool shm_ring::prepare_wait()
+{
+    header_->reader_waiting.store(1);
+    if (header_->head.load() != header_->tail.load()) {
+        header_->reader_waiting.store(0);
+        return true;
+    }
+
+    return false;
+}
+
+void shm_ring::done_waiting()
+{
+    header_->reader_waiting.store(0);
+
+    uint64_t count;
+    while (read(readable_fd_, &count, sizeof(count)) == -1 && errno == EINTR);
+}
+
+void shm_ring::close()
+{
+    header_->closed.store(1);
+    wake(writable_fd_);
+}
+
+bool shm_ring::closed() const
+{
+    return header_->closed.load() != 0;
+}
+
+void shm_ring::wake(int fd)
+{
+    const uint64_t one = 1;
+    while (::write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+/* ns bookwyrm */
+}
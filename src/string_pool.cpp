@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "string_pool.hpp"
+
+/*
+ * How large the chunks are that strings are copied into. Strings longer than a
+ * quarter of that get a chunk of their own, so that little is left unused.
+ */
+static constexpr size_t chunk_size = 64 * 1024;
+
+namespace bookwyrm {
+
+string_view string_pool::intern(const string_view &str)
+{
+    if (str.empty()) return {};
+
+    if (const auto found = stored_.find(str); found != stored_.cend())
+        return *found;
+
+    const auto stored = store(str);
+    stored_.insert(stored);
+    return stored;
+}
+
+size_t string_pool::count() const
+{
+    return stored_.size();
+}
+
+size_t string_pool::bytes() const
+{
+    return bytes_;
+}
+
+string_view string_pool::store(const string_view &str)
+{
+    char *dest;
+
+    if (str.size() > chunk_size / 4) {
+        /* The current chunk stays current, so whatever is left of it is still used. */
+        chunks_.push_back(std::make_unique<char[]>(str.size()));
+        dest = chunks_.back().get();
+    } else {
+        if (str.size() > left_) {
+            chunks_.push_back(std::make_unique<char[]>(chunk_size));
+            free_ = chunks_.back().get();
+            left_ = chunk_size;
+        }
+
+        dest = free_;
+        free_ += str.size();
+        left_ -= str.size();
+    }
+
+    std::memcpy(dest, str.data(), str.size());
+    bytes_ += str.size();
+    return {dest, str.size()};
+}
+
+/* ns bookwyrm */
+}
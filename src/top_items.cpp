@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+
+#include "top_items.hpp"
+
+namespace bookwyrm {
+
+/*
+ * How many changes may wait for the follower without taking a lock. Should it fall
+ * further behind, the rest wait in a list of their own until it catches up.
+ */
+static constexpr size_t change_capacity = 1024;
+
+top_items::top_items(item_store &store, size_t k)
+    : store_(store), k_(k), changes_(change_capacity) {}
+
+std::optional<size_t> top_items::offer(item &&candidate)
+{
+    const int score = candidate.score();
+
+    if (kept_.size() == k_) {
+        if (score <= kept_.top().first)
+            return std::nullopt;
+
+        publish({kept_.top().second, false});
+        kept_.pop();
+    }
+
+    /* Reuse a slot if the follower has let go of one. */
+    size_t idx = store_.size();
+    {
+        std::lock_guard<std::mutex> guard(released_mutex_);
+        if (!released_.empty()) {
+            idx = released_.back();
+            released_.pop_back();
+        }
+    }
+
+    if (idx < store_.size())
+        store_.replace(idx, std::move(candidate));
+    else
+        store_.push_back(std::move(candidate));
+
+    kept_.emplace(score, idx);
+    publish({idx, true});
+    return idx;
+}
+
+void top_items::publish(change c)
+{
+    if (!overflowed_.load() && changes_.try_push(c))
+        return;
+
+    std::lock_guard<std::mutex> guard(overflow_mutex_);
+    overflow_.push_back(c);
+    overflowed_ = true;
+}
+
+void top_items::follow(const std::function<void(size_t)> &filled, const std::function<void(size_t)> &evicted)
+{
+    vector<change> changes;
+    {
+        /* What is in changes_ came before what overflowed: nothing goes there while anything has. */
+        std::lock_guard<std::mutex> guard(overflow_mutex_);
+        changes_.consume([&changes](change &&c) { changes.push_back(c); }, std::numeric_limits<size_t>::max());
+
+        changes.insert(changes.end(), overflow_.cbegin(), overflow_.cend());
+        overflow_.clear();
+        overflowed_ = false;
+    }
+
+    for (const auto &c : changes) {
+        if (c.filled)
+            filled(c.idx);
+        else
+            evicted(c.idx);
+    }
+}
+
+void top_items::release(size_t idx)
+{
+    std::lock_guard<std::mutex> guard(released_mutex_);
+    released_.push_back(idx);
+}
+
+/* ns bookwyrm */
+}
@@ -55,6 +55,15 @@ string vector_to_string(const vector<string> &vec)
     return retstring;
 }
 
+string vector_to_string(const vector<string_view> &vec)
+{
+    string retstring = "";
+    for (size_t i = 0; i < vec.size(); i++)
+        retstring.append(vec[i].data(), vec[i].size()).append(i + 1 < vec.size() ? ", " : "");
+
+    return retstring;
+}
+
 vector<string> split_string(const string &str)
 {
     vector<string> tokens;
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "errors.hpp"
+#include "wire.hpp"
+
+namespace wire {
+
+template <typename T>
+static void put(string &buf, T value)
+{
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put(string &buf, const string_view &str)
+{
+    put<uint32_t>(buf, str.size());
+    buf.append(str.data(), str.size());
+}
+
+static void put(string &buf, const vector<string_view> &strs)
+{
+    put<uint32_t>(buf, strs.size());
+    for (const auto &str : strs)
+        put(buf, str);
+}
+
+void put_item(string &buf, const bookwyrm::nonexacts_t &nonexacts, const bookwyrm::exacts_t &exacts,
+        const bookwyrm::misc_t &misc)
+{
+    put(buf, kind::item);
+
+    put(buf, nonexacts.authors());
+    put(buf, nonexacts.title());
+    put(buf, nonexacts.series());
+    put(buf, nonexacts.publisher());
+    put(buf, nonexacts.journal());
+
+    for (const int value : exacts.store())
+        put<int32_t>(buf, value);
+    put(buf, exacts.extension());
+
+    put(buf, misc.uris());
+    put(buf, misc.isbns());
+}
+
+void put_log(string &buf, spdlog::level::level_enum lvl, const string &msg)
+{
+    put(buf, kind::log);
+    put<int32_t>(buf, lvl);
+    put(buf, string_view(msg));
+}
+
+/* Takes values off the front of a record. */
+class cursor {
+public:
+    explicit cursor(const string_view &record)
+        : rest_(record) {}
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, take(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    string_view get_string()
+    {
+        return take(get<uint32_t>());
+    }
+
+    vector<string_view> get_strings()
+    {
+        /* Each takes at least its length; don't allocate for more than could be there. */
+        const auto count = get<uint32_t>();
+        if (count > rest_.size() / sizeof(uint32_t))
+            throw value_error("malformed record: truncated");
+
+        vector<string_view> strs(count);
+        for (auto &str : strs)
+            str = get_string();
+
+        return strs;
+    }
+
+    bool done() const
+    {
+        return rest_.empty();
+    }
+
+private:
+    string_view take(size_t size)
+    {
+        if (size > rest_.size())
+            throw value_error("malformed record: truncated");
+
+        const auto front = rest_.substr(0, size);
+        rest_.remove_prefix(size);
+        return front;
+    }
+
+    string_view rest_;
+};
+
+kind kind_of(const string_view &record)
+{
+    if (record.empty())
+        throw value_error("malformed record: empty");
+
+    const auto k = static_cast<kind>(record.front());
+    if (k != kind::item && k != kind::log)
+        throw value_error("malformed record: unknown kind");
+
+    return k;
+}
+
+bookwyrm::item get_item(const string_view &record)
+{
+    cursor c(record);
+    if (c.get<kind>() != kind::item)
+        throw value_error("malformed record: not an item");
+
+    auto authors = c.get_strings();
+    const auto title = c.get_string(),
+               series = c.get_string(),
+               publisher = c.get_string(),
+               journal = c.get_string();
+
+    std::array<int32_t, 5> numbers;
+    for (auto &n : numbers)
+        n = c.get<int32_t>();
+    const auto extension = c.get_string();
+
+    auto uris = c.get_strings();
+    auto isbns = c.get_strings();
+
+    if (!c.done())
+        throw value_error("malformed record: trailing bytes");
+
+    return bookwyrm::item(std::make_tuple(
+        bookwyrm::nonexacts_t(std::move(authors), title, series, publisher, journal),
+        bookwyrm::exacts_t(numbers[0], numbers[1], numbers[2], numbers[3], numbers[4], extension),
+        bookwyrm::misc_t(std::move(uris), std::move(isbns))));
+}
+
+std::pair<spdlog::level::level_enum, string> get_log(const string_view &record)
+{
+    cursor c(record);
+    if (c.get<kind>() != kind::log)
+        throw value_error("malformed record: not a log entry");
+
+    const auto lvl = c.get<int32_t>();
+    const auto msg = c.get_string();
+
+    if (!c.done() || lvl < spdlog::level::trace || lvl > spdlog::level::off)
+        throw value_error("malformed record: bad log entry");
+
+    return {static_cast<spdlog::level::level_enum>(lvl), string(msg)};
+}
+
+/* ns wire */
+}
@@ -0,0 +1,216 @@
+#! /usr/bin/env python3
+#
+# Check that bookwyrm's fuzzy ratios (src/fuzzy.cpp) are fuzzywuzzy's, by running
+# fixed pairs of titles and queries through both: bookwyrm's through fuzzy_pairs,
+# and fuzzywuzzy's as written out below (difflib, without python-Levenshtein),
+# which is itself checked against fuzzywuzzy when that is installed.
+#
+# Strings are compared as bytes, as fuzzywuzzy's C++ port does.
+#
+# Usage: fuzzy_compare.py path/to/fuzzy_pairs
+
+import random
+import re
+import subprocess
+import sys
+from difflib import SequenceMatcher
+
+
+def intr(n):
+    return int(round(n))
+
+
+def ratio(a, b):
+    if a == b:
+        return 100
+    if not a or not b:
+        return 0
+
+    return intr(100 * SequenceMatcher(None, a, b).ratio())
+
+
+def partial_ratio(a, b):
+    if a == b:
+        return 100
+    if not a or not b:
+        return 0
+
+    shorter, longer = (a, b) if len(a) <= len(b) else (b, a)
+
+    scores = []
+    for i, j, _ in SequenceMatcher(None, shorter, longer).get_matching_blocks():
+        start = max(j - i, 0)
+        r = SequenceMatcher(None, shorter, longer[start:start + len(shorter)]).ratio()
+        if r > .995:
+            return 100
+        scores.append(r)
+
+    return intr(100 * max(scores))
+
+
+def full_process(s):
+    s = bytes(c for c in s if c < 0x80).decode('ascii')
+    return re.sub(r'\W', ' ', s).lower().strip().encode('ascii')
+
+
+def token_set_ratio(a, b):
+    a, b = full_process(a), full_process(b)
+    if not a or not b:
+        return 0
+
+    tokens_a, tokens_b = set(a.split()), set(b.split())
+    sect = b' '.join(sorted(tokens_a & tokens_b))
+    a_all = (sect + b' ' + b' '.join(sorted(tokens_a - tokens_b))).strip()
+    b_all = (sect + b' ' + b' '.join(sorted(tokens_b - tokens_a))).strip()
+
+    return max(ratio(sect, a_all), ratio(sect, b_all), ratio(a_all, b_all))
+
+
+REFERENCE = {
+    'ratio': ratio,
+    'partial': partial_ratio,
+    'partial75': partial_ratio,
+    'token_set': token_set_ratio,
+}
+
+TITLES = [
+    'The Art of Computer Programming',
+    'The Art of Computer Programming, Volume 1: Fundamental Algorithms',
+    'Structure and Interpretation of Computer Programs',
+    'Introduction to Algorithms (3rd ed.)',
+    'introduction to algorithms',
+    'Algorithms + Data Structures = Programs',
+    'A Discipline of Programming',
+    'Some Title (42)',
+    'Some Title',
+    'some title',
+    'Gödel, Escher, Bach: an Eternal Golden Braid',
+    'Goedel Escher Bach',
+    'Война и мир',
+    'The C++ Programming Language',
+    'the_c_programming_language',
+    '  padded   title  ',
+    'aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab',
+    'abcd',
+    'dcba',
+    'a',
+    '',
+]
+
+AUTHORS = [
+    'Donald E. Knuth',
+    'Knuth, Donald Ervin',
+    'D. Knuth',
+    'Harold Abelson, Gerald Jay Sussman',
+    'Sussman Abelson',
+    'Niklaus Wirth',
+    'Edsger W. Dijkstra',
+    'Douglas R. Hofstadter',
+    'Лев Толстой',
+    'Thomas H. Cormen; Charles E. Leiserson; Ronald L. Rivest; Clifford Stein',
+    '',
+]
+
+
+def mutate(rng, s):
+    """A query someone might type for a title: cut, retyped and misspelt."""
+    s = bytearray(s)
+    for _ in range(rng.randrange(4)):
+        op = rng.randrange(4)
+        pos = rng.randrange(len(s) + 1)
+        if op == 0 and s:
+            del s[pos:pos + rng.randrange(1, 12)]
+        elif op == 1:
+            s.insert(pos, rng.choice(b'abcdefghijklmnopqrstuvwxyz ,.-'))
+        elif op == 2 and pos < len(s):
+            s[pos] = rng.choice(b'abcdefghijklmnopqrstuvwxyz ')
+        elif op == 3:
+            s = s.swapcase()
+    return bytes(s)
+
+
+def pairs():
+    titles = [t.encode() for t in TITLES]
+    authors = [a.encode() for a in AUTHORS]
+
+    # Long enough for difflib's autojunk to kick in.
+    titles.append(b' '.join(titles[:9]))
+    titles.append(b'the ' * 60 + b'end')
+
+    for a in titles:
+        for b in titles:
+            for kind in ('ratio', 'partial', 'partial75'):
+                yield kind, a, b
+
+    for a in authors:
+        for b in authors:
+            yield 'token_set', a, b
+
+    rng = random.Random(2017)
+    for _ in range(2000):
+        title = rng.choice(titles)
+        yield rng.choice(('ratio', 'partial', 'partial75')), mutate(rng, title), title
+        author = rng.choice(authors)
+        yield 'token_set', mutate(rng, author), author
+
+
+def check_reference(cases):
+    """Check the reference against fuzzywuzzy itself, if it is installed."""
+    try:
+        from fuzzywuzzy import fuzz
+    except ImportError:
+        return 0
+
+    theirs = {
+        'ratio': fuzz.ratio,
+        'partial': fuzz.partial_ratio,
+        'partial75': fuzz.partial_ratio,
+        'token_set': fuzz.token_set_ratio,
+    }
+
+    failures = 0
+    for kind, a, b in cases:
+        if not (a + b).isascii():
+            continue  # fuzzywuzzy compares characters, not bytes
+
+        expected = theirs[kind](a.decode(), b.decode())
+        if REFERENCE[kind](a, b) != expected:
+            print('reference differs from fuzzywuzzy: {} {!r} {!r}'.format(kind, a, b))
+            failures += 1
+
+    return failures
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('usage: {} path/to/fuzzy_pairs'.format(sys.argv[0]))
+
+    # Tabs and newlines separate the fields.
+    cases = [(k, a.replace(b'\t', b' '), b.replace(b'\t', b' ')) for k, a, b in pairs()
+             if b'\n' not in a + b]
+
+    stdin = b''.join(k.encode() + b'\t' + a + b'\t' + b + b'\n' for k, a, b in cases)
+    out = subprocess.run([sys.argv[1]], input=stdin, stdout=subprocess.PIPE, check=True).stdout
+    got = [int(line) for line in out.split()]
+
+    if len(got) != len(cases):
+        sys.exit('expected {} ratios, got {}'.format(len(cases), len(got)))
+
+    failures = check_reference(cases)
+    for (kind, a, b), ours in zip(cases, got):
+        expected = REFERENCE[kind](a, b)
+
+        # Below the cutoff, all that matters is that it is.
+        if kind == 'partial75' and expected < 75 and ours < 75:
+            continue
+
+        if ours != expected:
+            print('{}({!r}, {!r}): got {}, expected {}'.format(kind, a, b, ours, expected))
+            failures += 1
+
+    print('{} pairs compared, {} differ'.format(len(cases), failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
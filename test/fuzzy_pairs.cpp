@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 Tmplt <tmplt@dragons.rocks>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Prints the fuzzy ratios of pairs of strings, for fuzzy_compare.py to check.
+ * Reads lines of "kind<TAB>a<TAB>b" from stdin, and prints one ratio per line.
+ * The kinds are ratio, partial, partial75 (with a cutoff of 75) and token_set.
+ */
+
+#include <iostream>
+
+#include "fuzzy.hpp"
+
+static int token_set_ratio(string_view a, string_view b, fuzzy::scratch &s)
+{
+    string a_processed, b_processed;
+    vector<string_view> a_tokens, b_tokens;
+
+    fuzzy::tokenize(fuzzy::full_process(a, a_processed), a_tokens);
+    fuzzy::tokenize(fuzzy::full_process(b, b_processed), b_tokens);
+    return fuzzy::token_set_ratio(a_tokens, b_tokens, s);
+}
+
+int main()
+{
+    fuzzy::scratch s;
+    string line;
+
+    while (std::getline(std::cin, line)) {
+        const auto tab = line.find('\t'), second = line.find('\t', tab + 1);
+        if (tab == string::npos || second == string::npos) {
+            std::cerr << "malformed line: " << line << '\n';
+            return 1;
+        }
+
+        const string kind = line.substr(0, tab);
+        const string_view a = string_view(line).substr(tab + 1, second - tab - 1),
+                          b = string_view(line).substr(second + 1);
+
+        if (kind == "ratio")
+            std::cout << fuzzy::ratio(a, b, s) << '\n';
+        else if (kind == "partial")
+            std::cout << fuzzy::partial_ratio(a, b, s) << '\n';
+        else if (kind == "partial75")
+            std::cout << fuzzy::partial_ratio(a, fuzzy::pattern(b), s, 75) << '\n';
+        else if (kind == "token_set")
+            std::cout << token_set_ratio(a, b, s) << '\n';
+        else {
+            std::cerr << "unknown kind: " << kind << '\n';
+            return 1;
+        }
+    }
+}